@@ -0,0 +1,24 @@
+#version 330 core
+
+// input data : sent from main program
+layout (location = 0) in vec3 vertexPosition;
+layout (location = 2) in vec3 blockInstance; // (x, y, type) - one per block
+
+// View-projection of the current viewport, shared by all programs
+layout (std140) uniform Camera {
+    mat4 VP;
+};
+
+// output data : used by fragment shader
+out vec3 fragColor;
+
+// Block colours indexed by type - red, green and blue boxes
+const vec3 blockColors[3] = vec3[3](vec3(255, 0, 0), vec3(0, 255, 0), vec3(0, 191, 255));
+
+void main ()
+{
+    fragColor = blockColors[int(blockInstance.z)];
+
+    // Shared quad is moved to the block's position, then projected : VP * position
+    gl_Position = VP * vec4(vertexPosition.xy + blockInstance.xy, vertexPosition.z, 1);
+}
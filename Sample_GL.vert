@@ -4,19 +4,30 @@
 layout (location = 0) in vec3 vertexPosition;
 layout (location = 1) in vec3 vertexColor;
 
-uniform mat4 MVP;
+// View-projection of the current viewport, shared by all programs
+layout (std140) uniform Camera {
+    mat4 VP;
+};
+
+// Model transform : offset x, offset y, rotation in radians, x scale
+uniform vec4 transform;
+// Rotation and scale are about this point
+uniform vec2 pivot;
 
 // output data : used by fragment shader
 out vec3 fragColor;
 
 void main ()
 {
-    vec4 v = vec4(vertexPosition, 1); // Transform an homogeneous 4D vector
+    vec2 p = vertexPosition.xy - pivot;
+    p.x *= transform.w;
+    p = vec2(p.x*cos(transform.z) - p.y*sin(transform.z), p.x*sin(transform.z) + p.y*cos(transform.z));
+    vec4 v = vec4(p + pivot + transform.xy, vertexPosition.z, 1); // Transform an homogeneous 4D vector
 
     // The color of each vertex will be interpolated
     // to produce the color of each fragment
     fragColor = vertexColor;
 
-    // Output position of the vertex, in clip space : MVP * position
-    gl_Position = MVP * v;
+    // Output position of the vertex, in clip space : VP * position
+    gl_Position = VP * v;
 }
@@ -0,0 +1,27 @@
+#version 330 core
+
+// input data : sent from main program
+layout (location = 0) in vec3 vertexPosition;
+layout (location = 1) in vec3 vertexColor;
+layout (location = 2) in vec3 segmentInstance; // (x, y, horizontal) - one per lit segment
+
+// View-projection of the current viewport, shared by all programs
+layout (std140) uniform Camera {
+    mat4 VP;
+};
+uniform float scale;
+
+// output data : used by fragment shader
+out vec3 fragColor;
+
+void main ()
+{
+    fragColor = vertexColor;
+
+    // Horizontal segments are the upright tile turned by -90 degrees
+    vec2 tile = vertexPosition.xy;
+    if (segmentInstance.z > 0.5)
+        tile = vec2(tile.y, -tile.x);
+
+    gl_Position = VP * vec4(segmentInstance.xy + scale*tile, vertexPosition.z, 1);
+}
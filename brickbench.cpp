@@ -0,0 +1,314 @@
+/* Steps the game with no window, no GL and no sound, as fast as it will go,
+   and reports how many steps a second the core manages. By default the
+   cannon sweeps back and forth with the death ray held down so every part of
+   a step runs; --bot plays instead. --farm N plays N whole games side by side
+   on every core and reports how they went */
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <chrono>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "brickcore.h"
+
+using namespace std;
+
+#define MAX_FARM_THREADS 256
+
+// Settings every game is started with
+int maxBlocks = 5000;
+float updateTime = 1, speed = 0.05;
+long steps = 1000000;
+uint64_t seed;
+bool useBot;
+
+/* Press or release a key as of now, if it is not that way already */
+void sendKey (GameState *game, GameKey key, bool pressed)
+{
+  InputEvent event;
+
+  if(game->keyStates[key] == pressed)
+    return;
+
+  event.time = 0;
+  event.type = INPUT_KEY;
+  event.code = key;
+  event.pressed = pressed;
+  event.x = event.y = 0;
+  applyInput(game, &event);
+}
+
+/* Hold the left mouse button down at (x, y), or let go of it */
+void sendMouse (GameState *game, bool pressed, double x, double y)
+{
+  InputEvent event;
+
+  if(!pressed && !game->mouseStates[GAME_BUTTON_LEFT])
+    return;
+
+  event.time = 0;
+  event.type = game->mouseStates[GAME_BUTTON_LEFT] && pressed ? INPUT_CURSOR : INPUT_MOUSE_BUTTON;
+  event.code = GAME_BUTTON_LEFT;
+  event.pressed = pressed;
+  event.x = x;
+  event.y = y;
+  applyInput(game, &event);
+}
+
+/* Scripted input - swing the cannon up for a second of game time, then down for one, with the ray held down */
+void sweepInput (GameState *game, long step)
+{
+  long sweepSteps = (long)(1.0/simTimeStep);
+  bool up = (step/sweepSteps) % 2 == 0;
+
+  sendKey(game, GAME_KEY_SPACE, true);
+  sendKey(game, up ? GAME_KEY_D : GAME_KEY_A, false);
+  sendKey(game, up ? GAME_KEY_A : GAME_KEY_D, true);
+}
+
+/* Bot input - slide each bucket under the lowest block of its colour, and
+   drag the cannon onto the lowest blue block and fire when it can be reached.
+   A bucket is moved every other step, as both share the arrow keys */
+void botInput (GameState *game, long step)
+{
+  int i, b, lowest[3] = {-1, -1, -1};
+  const BlockStore &blocks = game->blocks;
+
+  // Lowest block of each type that is still above the buckets
+  for(i = 0; i < blocks.count; i++)
+  {
+    int t = blocks.type[i];
+    if(blockInitY + blocks.y[i] > screenBottomY + 1.5f && (lowest[t] == -1 || blocks.y[i] < blocks.y[lowest[t]]))
+      lowest[t] = i;
+  }
+
+  b = step % 2;
+  sendKey(game, b == 0 ? GAME_KEY_LEFT_CONTROL : GAME_KEY_LEFT_ALT, false);
+  sendKey(game, b == 0 ? GAME_KEY_LEFT_ALT : GAME_KEY_LEFT_CONTROL, true);
+  if(lowest[b] >= 0)
+  {
+    float centre = (game->bucketInfo[b].topLeft + game->bucketInfo[b].topRight)/2;
+    sendKey(game, GAME_KEY_LEFT, centre > blocks.x[lowest[b]] + 0.2f);
+    sendKey(game, GAME_KEY_RIGHT, centre < blocks.x[lowest[b]] - 0.2f);
+  }
+  else
+  {
+    sendKey(game, GAME_KEY_LEFT, false);
+    sendKey(game, GAME_KEY_RIGHT, false);
+  }
+
+  if(lowest[2] >= 0)
+  {
+    float x = blocks.x[lowest[2]], y = blockInitY + blocks.y[lowest[2]] + 0.15f;
+    float angle = atan2(y - game->cannonInfo.y, x - screenLeftX)*180.0f/M_PI;
+    if(fabs(angle) < 45.0f)
+    {
+      sendMouse(game, true, x, y);
+      sendKey(game, GAME_KEY_SPACE, true);
+      return;
+    }
+  }
+  sendMouse(game, false, 0, 0);
+  sendKey(game, GAME_KEY_SPACE, false);
+}
+
+void sendInput (GameState *game, long step)
+{
+  if(useBot)
+    botInput(game, step);
+  else
+    sweepInput(game, step);
+}
+
+/* Counts kept by one farm thread. Each sits on cache lines of its own so
+   threads bumping their counters never fight over a line */
+typedef struct alignas(64) FarmStats {
+  long steps;
+  long games;
+  long endedByHits, endedByCatch;  // Games lost to too many wrong hits or a wrong catch
+  long stepsToEnd;                 // Steps played, summed over the games that ended
+  vector<int> scores;
+} FarmStats;
+
+FarmStats farmStats[MAX_FARM_THREADS];
+atomic<int> nextGame;
+int farmGames;
+
+/* Play games off the farm until there are none left */
+void farmWorker (int index)
+{
+  FarmStats *stats = &farmStats[index];
+  GameState *game = new GameState;
+  int g;
+  long step;
+
+  while((g = nextGame++) < farmGames)
+  {
+    game->maxBlocks = maxBlocks;
+    game->updateTime = updateTime;
+    game->speed = speed;
+    game->seed = seed + g;
+    // Every core already has a game of its own
+    game->chunks.serial = true;
+    initGame(game);
+
+    for(step = 0; step < steps && !gameOver(game); step++)
+    {
+      sendInput(game, step);
+      update(game);
+      stats->steps++;
+    }
+
+    stats->games++;
+    stats->scores.push_back(game->score);
+    if(gameOver(game))
+    {
+      stats->stepsToEnd += step;
+      if(game->wrongHits >= maxWrongHits)
+        stats->endedByHits++;
+      else
+        stats->endedByCatch++;
+    }
+    freeGame(game);
+  }
+  delete game;
+}
+
+/* Play farmGames games on threads threads and report how they went */
+void runFarm (int threads)
+{
+  int i;
+  vector<thread> workers;
+  FarmStats total = FarmStats();
+
+  threads = min(threads, MAX_FARM_THREADS);
+  nextGame = 0;
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  for(i = 0; i < threads; i++)
+  {
+    workers.push_back(thread(farmWorker, i));
+  }
+  for(i = 0; i < threads; i++)
+  {
+    workers[i].join();
+  }
+  double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+  for(i = 0; i < threads; i++)
+  {
+    total.steps += farmStats[i].steps;
+    total.games += farmStats[i].games;
+    total.endedByHits += farmStats[i].endedByHits;
+    total.endedByCatch += farmStats[i].endedByCatch;
+    total.stepsToEnd += farmStats[i].stepsToEnd;
+    total.scores.insert(total.scores.end(), farmStats[i].scores.begin(), farmStats[i].scores.end());
+  }
+  sort(total.scores.begin(), total.scores.end());
+
+  long ended = total.endedByHits + total.endedByCatch;
+  double mean = 0.0;
+  for(i = 0; i < (int)total.scores.size(); i++)
+    mean += total.scores[i];
+  mean /= total.scores.size();
+
+  printf("Farm of %ld games on %d threads, up to %ld steps each, %s input, seeds %llu on\n", total.games, threads, steps, useBot ? "bot" : "scripted", (unsigned long long)seed);
+  printf("Block speed %.3f, a block every %.3f s, %s kernels\n\n", speed, updateTime, kernelName);
+  printf("%ld steps in %.3f s : %.0f steps per second, %.0f per thread\n\n", total.steps, seconds, total.steps/seconds, total.steps/seconds/threads);
+  printf("Score     min     p10  median     p90     max     mean\n");
+  printf("      %7d %7d %7d %7d %7d %8.1f\n\n", total.scores.front(), total.scores[total.scores.size()/10], total.scores[total.scores.size()/2],
+    total.scores[total.scores.size()*9/10], total.scores.back(), mean);
+  printf("Game over by wrong hits   : %ld (%.1f%%)\n", total.endedByHits, 100.0*total.endedByHits/total.games);
+  printf("Game over by wrong catch  : %ld (%.1f%%)\n", total.endedByCatch, 100.0*total.endedByCatch/total.games);
+  printf("Still playing at the end  : %ld (%.1f%%)\n", total.games - ended, 100.0*(total.games - ended)/total.games);
+  if(ended > 0)
+  {
+    printf("Mean time to game over    : %.1f s of game time\n", total.stepsToEnd*simTimeStep/ended);
+  }
+}
+
+int main (int argc, char** argv)
+{
+  long i;
+  int threads = 0;
+
+  // --steps N runs N steps (a game at most N steps on the farm), --max-blocks N and --spawn-interval S
+  // are as for the game, --speed V sets how fast blocks fall, --threads N sets the number of threads
+  // updating blocks (default 1) or playing farm games (default one per core), --farm N plays N games,
+  // --bot plays the game instead of sweeping the cannon, --seed N seeds the game (farm game g gets N + g)
+  for(i = 1; i < argc; i++)
+  {
+    if(!strcmp(argv[i], "--steps") && i + 1 < argc)
+    {
+      steps = max(atol(argv[++i]), 1L);
+    }
+    else if(!strcmp(argv[i], "--max-blocks") && i + 1 < argc)
+    {
+      maxBlocks = max(atoi(argv[++i]), 1);
+    }
+    else if(!strcmp(argv[i], "--spawn-interval") && i + 1 < argc)
+    {
+      updateTime = max(atof(argv[++i]), 0.000001);
+    }
+    else if(!strcmp(argv[i], "--speed") && i + 1 < argc)
+    {
+      speed = min(max(atof(argv[++i]), 0.001), 0.1);
+    }
+    else if(!strcmp(argv[i], "--threads") && i + 1 < argc)
+    {
+      threads = max(atoi(argv[++i]), 1);
+    }
+    else if(!strcmp(argv[i], "--farm") && i + 1 < argc)
+    {
+      farmGames = max(atoi(argv[++i]), 1);
+    }
+    else if(!strcmp(argv[i], "--seed") && i + 1 < argc)
+    {
+      seed = strtoull(argv[++i], NULL, 10);
+    }
+    else if(!strcmp(argv[i], "--bot"))
+    {
+      useBot = true;
+    }
+  }
+
+  if(farmGames > 0)
+  {
+    runFarm(threads > 0 ? threads : max((int)thread::hardware_concurrency(), 1));
+    return 0;
+  }
+
+  threads = max(threads, 1);
+  startScheduler(threads);
+
+  GameState *game = new GameState;
+  game->maxBlocks = maxBlocks;
+  game->updateTime = updateTime;
+  game->speed = speed;
+  game->seed = seed;
+  initGame(game);
+
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  for(i = 0; i < steps; i++)
+  {
+    sendInput(game, i);
+    update(game);
+  }
+  double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+  printf("%ld steps (%.0f s of game time) in %.3f s with %d threads, %s kernels\n", steps, steps*simTimeStep, seconds, threads, kernelName);
+  printf("%.0f steps per second, %.3f us per step\n\n", steps/seconds, 1000000.0*seconds/steps);
+  printf("Score %d, %d wrong hits, %d wrong catches, %d blocks live\n", game->score, game->wrongHits, game->wrongCatch, game->blocks.count);
+  if(game->blocks.exhausted > 0)
+  {
+    printf("Blocks not spawned because the pool of %d was full : %ld\n", game->maxBlocks, game->blocks.exhausted);
+  }
+
+  freeGame(game);
+  delete game;
+  stopScheduler();
+  return 0;
+}
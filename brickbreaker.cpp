@@ -6,6 +6,10 @@
 #include <ctime>
 #include <cstring>
 #include <stdlib.h>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
 
 #include <mpg123.h>
 #include <ao/ao.h>
@@ -18,9 +22,17 @@
 #include <glm/gtx/transform.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include "brickcore.h"
+
 using namespace std;
 
 #define BITS 8
+#define INSTANCE_REGIONS 3
+#define MAX_SCORE_DIGITS 10
+#define AUDIO_RING_SIZE (1 << 16)
+#define AUDIO_CHUNK 4096
+#define AUDIO_MAX_FAILURES 20 // Reads in a row that give nothing before the decoder gives up
+#define INPUT_QUEUE_SIZE 1024
 
 struct VAO {
     GLuint VertexArrayID;
@@ -29,76 +41,88 @@ struct VAO {
 
     GLenum PrimitiveMode;
     GLenum FillMode;
+    GLfloat LineWidth;
+    int First; // Index of the first vertex - non zero for objects in the shared static buffer
     int NumVertices;
 };
 typedef struct VAO VAO;
 
 struct GLMatrices {
 	glm::mat4 projection;
-	glm::mat4 model;
 	glm::mat4 view;
-	GLuint MatrixID;
+	GLuint CameraBuffer; // UBO holding projection * view for the viewport being drawn
+	GLuint TransformID;
+	GLuint PivotID;
 } Matrices;
 
-typedef struct Block {
-  float initY;
-  float x;
-  float y;
-  int type;
-} Block;
-
-typedef struct Bucket {
-  float topLeft;
-  float topRight;
-  float bottomLeft;
-  float bottomRight;
-  float initLeft;
-  bool selected;
-} Bucket;
-
-typedef struct Mirror {
-  float x;
-  float y;
-  float length;
-  float angle;
-  float intersectionX;
-} Mirror;
-
-typedef struct Cannon {
-  float y;
-  float angle;
-  static const float length = 1.5;
-  static const float thickness = 0.3;
-  bool selected;
-} Cannon;
-
-typedef struct Points {
-  float x;
-  float y;
-} Points;
-
-int score, mirrorCount, wrongHits, wrongCatch;
-float updateTime = 1, speed = 0.05, rayPoints[2];
-double mouseX, mouseY;
-Points potentialIntersections[10];
-Block blockInfo[5000];
-Bucket bucketInfo[2];
-Mirror mirrorInfo[5];
-Cannon cannonInfo;
-VAO *bucket[2], * blocks[5000], * mirrors[5], *deathRay[100], *scoreTile[3][7], *cannon, *scoreBackground, *battery, *batteryTip, *batteryStatus;
-bool selected, * keyStates = new bool[500];
-static const float screenLeftX = -11.0;
-static const float screenRightX = 11.0;
-static const float screenTopY = 6.0;
-static const float screenBottomY = -6.0;
+GameState game; // Stepped only by the simulation thread once it starts
+VAO *bucket[2], * blockQuad, * mirrors[5], *deathRay, *scoreTile, *cannon, *scoreBackground, *battery, *batteryTip, *batteryStatus;
 static const float scoreLeftX = 5.0;
 static const float scoreRightX = 10.0;
 float displayLeft = -11.0, displayRight = 5.0, displayTop = 6.0, displayBottom = -6.0, horizontalZoom = 0, verticalZoom = 0;
-// Indicate amount of "juice" left in battery
-float juiceStartX = screenLeftX + 0.2, juiceStartY = screenTopY - 0.5, juiceEndY = screenTopY - 1.0, juiceEndX = juiceStartX;
-GLFWwindow* windowCopy;
-
-GLuint programID;
+// Visible area of the viewport currently being drawn - anything outside it is culled
+float viewLeft, viewRight, viewBottom, viewTop;
+// Culling statistics - blocks sent to the GPU and blocks skipped, this frame and in total
+int blocksSubmitted, blocksCulled;
+long totalBlocksSubmitted, totalBlocksCulled, framesDrawn;
+// Frames longer than this are cut short so the simulation never spirals
+static const double maxFrameTime = 0.25;
+
+/* Input as it arrived in the GLFW callbacks, stamped with the time it happened.
+   The callbacks push on the main thread and the simulation drains the queue
+   step by step, so each press or release lands on the step it belongs to */
+typedef struct InputQueue {
+  InputEvent events[INPUT_QUEUE_SIZE];
+  alignas(64) atomic<unsigned> head;  // Owned by the callbacks
+  alignas(64) atomic<unsigned> tail;  // Owned by the simulation
+  long dropped;                       // Events lost to a full queue
+} InputQueue;
+
+InputQueue inputQueue;
+
+GLuint programID, blockProgramID, segmentProgramID, segmentScaleID;
+
+// Per-instance (x, y, type) of every live block, drawn with one instanced call
+GLuint blockInstanceBuffer;
+GLfloat *blockInstanceData;
+int blockInstanceCapacity; // Blocks each region of the instance buffer can hold
+/* With buffer storage the instance buffer is mapped once and split into
+   INSTANCE_REGIONS regions, each guarded by a fence. Without it blockInstanceMap
+   is NULL and blockInstanceData is uploaded into orphaned storage instead */
+GLfloat *blockInstanceMap;
+GLsync blockInstanceFence[INSTANCE_REGIONS];
+int blockInstanceRegion, blockInstanceCount;
+
+// Per-instance (x, y, horizontal) of every lit score segment, drawn with one instanced call
+GLuint segmentInstanceBuffer;
+GLfloat segmentInstanceData[3*7*MAX_SCORE_DIGITS];
+
+/* Everything the renderer needs from one simulation step. The simulation
+   thread fills the back snapshot and swaps it into the middle slot; the
+   render thread swaps the middle slot out whenever it holds something newer
+   than what is on screen. Mirrors never change after creation so they are
+   read directly */
+typedef struct Snapshot {
+  float *x, *y;
+  int *type;
+  int count, capacity;
+  float bucketOffset[2];
+  float cannonY, cannonAngle;
+  float juiceEndX;
+  int score, wrongHits, wrongCatch;
+  int raySegmentCount;
+  GLfloat rayVertexData[6*MAX_RAY_SEGMENTS];
+} Snapshot;
+
+#define SNAPSHOT_FRESH 4 // Set on the middle index when it has not been shown yet
+
+Snapshot snapshots[3];
+int snapshotBack = 0, snapshotFront = 1;
+atomic<int> snapshotMiddle(2);
+Snapshot *scene = &snapshots[1]; // The snapshot being drawn
+
+thread simThread;
+atomic<bool> simQuit;
 
 /* Function to load Shaders - Use it as it is */
 GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path) {
@@ -189,6 +213,65 @@ void quit(GLFWwindow *window)
 //    exit(EXIT_SUCCESS);
 }
 
+/* Shadow of the GL state changed per draw - lets redundant state calls be skipped */
+struct GLStateCache {
+    GLuint Program;
+    GLuint VertexArrayID;
+    GLenum PolygonMode;
+    GLfloat LineWidth;
+    long SkippedCalls;
+} glState = {0, 0, GL_FILL, 1.0f, 0};
+
+void useProgram (GLuint program)
+{
+    if (glState.Program == program) {
+        glState.SkippedCalls++;
+        return;
+    }
+    glUseProgram (program);
+    glState.Program = program;
+}
+
+void bindVertexArray (GLuint vertexArrayID)
+{
+    if (glState.VertexArrayID == vertexArrayID) {
+        glState.SkippedCalls++;
+        return;
+    }
+    glBindVertexArray (vertexArrayID);
+    glState.VertexArrayID = vertexArrayID;
+}
+
+void setPolygonMode (GLenum mode)
+{
+    if (glState.PolygonMode == mode) {
+        glState.SkippedCalls++;
+        return;
+    }
+    glPolygonMode (GL_FRONT_AND_BACK, mode);
+    glState.PolygonMode = mode;
+}
+
+void setLineWidth (GLfloat width)
+{
+    if (glState.LineWidth == width) {
+        glState.SkippedCalls++;
+        return;
+    }
+    glLineWidth (width);
+    glState.LineWidth = width;
+}
+
+/* Replace what a per-frame buffer holds with size bytes of data. The old
+   storage is orphaned first - the driver hands back fresh memory instead of
+   waiting for the GPU to finish drawing from the last upload */
+void streamBufferData (GLuint buffer, GLsizeiptr capacity, GLsizeiptr size, const void *data)
+{
+  glBindBuffer (GL_ARRAY_BUFFER, buffer);
+  glBufferData (GL_ARRAY_BUFFER, capacity, NULL, GL_STREAM_DRAW);
+  glBufferSubData (GL_ARRAY_BUFFER, 0, size, data);
+}
+
 /* Generate VAO, VBOs and return VAO handle */
 struct VAO* create3DObject (GLenum primitive_mode, int numVertices, const GLfloat* vertex_buffer_data, const GLfloat* color_buffer_data, GLenum fill_mode=GL_FILL)
 {
@@ -196,6 +279,8 @@ struct VAO* create3DObject (GLenum primitive_mode, int numVertices, const GLfloa
     vao->PrimitiveMode = primitive_mode;
     vao->NumVertices = numVertices;
     vao->FillMode = fill_mode;
+    vao->LineWidth = 1.0f;
+    vao->First = 0;
 
     // Create Vertex Array Object
     // Should be done after CreateWindow and before any other GL calls
@@ -203,7 +288,7 @@ struct VAO* create3DObject (GLenum primitive_mode, int numVertices, const GLfloa
     glGenBuffers (1, &(vao->VertexBuffer)); // VBO - vertices
     glGenBuffers (1, &(vao->ColorBuffer));  // VBO - colors
 
-    glBindVertexArray (vao->VertexArrayID); // Bind the VAO
+    bindVertexArray (vao->VertexArrayID); // Bind the VAO
     glBindBuffer (GL_ARRAY_BUFFER, vao->VertexBuffer); // Bind the VBO vertices
     glBufferData (GL_ARRAY_BUFFER, 3*numVertices*sizeof(GLfloat), vertex_buffer_data, GL_STATIC_DRAW); // Copy the vertices into VBO
     glVertexAttribPointer(
@@ -214,6 +299,7 @@ struct VAO* create3DObject (GLenum primitive_mode, int numVertices, const GLfloa
                           0,                  // stride
                           (void*)0            // array buffer offset
                           );
+    glEnableVertexAttribArray(0); // Attribute state is kept in the VAO
 
     glBindBuffer (GL_ARRAY_BUFFER, vao->ColorBuffer); // Bind the VBO colors
     glBufferData (GL_ARRAY_BUFFER, 3*numVertices*sizeof(GLfloat), color_buffer_data, GL_STATIC_DRAW);  // Copy the vertex colors
@@ -225,6 +311,7 @@ struct VAO* create3DObject (GLenum primitive_mode, int numVertices, const GLfloa
                           0,                  // stride
                           (void*)0            // array buffer offset
                           );
+    glEnableVertexAttribArray(1);
 
     return vao;
 }
@@ -242,39 +329,113 @@ struct VAO* create3DObject (GLenum primitive_mode, int numVertices, const GLfloa
     return create3DObject(primitive_mode, numVertices, vertex_buffer_data, color_buffer_data, fill_mode);
 }
 
+// Vertices of every static object, packed into one VAO by uploadStaticGeometry
+vector<GLfloat> staticVertexData, staticColorData;
+vector<struct VAO*> staticObjects;
+struct VAO* staticGeometry;
+
+/* Append an object to the shared static geometry buffer and return its handle.
+   It can be drawn once uploadStaticGeometry() has been called */
+struct VAO* createStaticObject (GLenum primitive_mode, int numVertices, const GLfloat* vertex_buffer_data, const GLfloat* color_buffer_data, GLenum fill_mode=GL_FILL)
+{
+    struct VAO* vao = new struct VAO;
+    vao->PrimitiveMode = primitive_mode;
+    vao->NumVertices = numVertices;
+    vao->FillMode = fill_mode;
+    vao->LineWidth = 1.0f;
+    vao->First = staticVertexData.size()/3;
+
+    staticVertexData.insert(staticVertexData.end(), vertex_buffer_data, vertex_buffer_data + 3*numVertices);
+    staticColorData.insert(staticColorData.end(), color_buffer_data, color_buffer_data + 3*numVertices);
+    staticObjects.push_back(vao);
+
+    return vao;
+}
+
+/* Copy all static objects into one VAO/VBO pair and point their handles at it */
+void uploadStaticGeometry ()
+{
+    staticGeometry = create3DObject(GL_TRIANGLES, staticVertexData.size()/3, &staticVertexData[0], &staticColorData[0]);
+
+    for (size_t i=0; i<staticObjects.size(); i++) {
+        staticObjects[i]->VertexArrayID = staticGeometry->VertexArrayID;
+        staticObjects[i]->VertexBuffer = staticGeometry->VertexBuffer;
+        staticObjects[i]->ColorBuffer = staticGeometry->ColorBuffer;
+    }
+}
+
 /* Render the VBOs handled by VAO */
 void draw3DObject (struct VAO* vao)
 {
     // Change the Fill Mode for this object
-    glPolygonMode (GL_FRONT_AND_BACK, vao->FillMode);
+    setPolygonMode (vao->FillMode);
 
-    // Bind the VAO to use
-    glBindVertexArray (vao->VertexArrayID);
+    if (vao->PrimitiveMode == GL_LINES)
+        setLineWidth (vao->LineWidth);
 
-    // Enable Vertex Attribute 0 - 3d Vertices
-    glEnableVertexAttribArray(0);
-    // Bind the VBO to use
-    glBindBuffer(GL_ARRAY_BUFFER, vao->VertexBuffer);
-
-    // Enable Vertex Attribute 1 - Color
-    glEnableVertexAttribArray(1);
-    // Bind the VBO to use
-    glBindBuffer(GL_ARRAY_BUFFER, vao->ColorBuffer);
+    // Bind the VAO to use - attributes and their VBOs were set up in create3DObject
+    bindVertexArray (vao->VertexArrayID);
 
     // Draw the geometry !
-    glDrawArrays(vao->PrimitiveMode, 0, vao->NumVertices); // Starting from vertex 0; 3 vertices total -> 1 triangle
+    glDrawArrays(vao->PrimitiveMode, vao->First, vao->NumVertices); // Starting from vertex First; 3 vertices total -> 1 triangle
+}
+
+/* Render a layer of objects with a single call - they must share the VAO,
+   primitive and fill mode, as objects from createStaticObject do */
+void draw3DObjects (struct VAO** vaos, int count)
+{
+    GLint first[16];
+    GLsizei numVertices[16];
+
+    assert(count <= 16);
+    if (count == 0)
+        return;
+
+    for (int i=0; i<count; i++) {
+        first[i] = vaos[i]->First;
+        numVertices[i] = vaos[i]->NumVertices;
+    }
+
+    setPolygonMode (vaos[0]->FillMode);
+    if (vaos[0]->PrimitiveMode == GL_LINES)
+        setLineWidth (vaos[0]->LineWidth);
+    bindVertexArray (vaos[0]->VertexArrayID);
+
+    glMultiDrawArrays(vaos[0]->PrimitiveMode, first, numVertices, count);
 }
 
 /**************************
  * Game specific code *
  **************************/
 
-void checkAndSelect();
-void moveSelected();
-void resetMouseCoordinates();
-void resetMirrors();
-void resetPotentialIntersections();
-void resetSelectState();
+/* Check whether a bounding box overlaps the visible area of the current viewport.
+   A box that only touches an edge shows nothing, so it does not count */
+bool isVisible (float left, float right, float bottom, float top)
+{
+  return right > viewLeft && left < viewRight && top > viewBottom && bottom < viewTop;
+}
+
+void setView (float left, float right, float bottom, float top)
+{
+  viewLeft = left;
+  viewRight = right;
+  viewBottom = bottom;
+  viewTop = top;
+  Matrices.projection = glm::ortho(left, right, bottom, top, 0.1f, 500.0f);
+
+  // Shared by every shader through the Camera uniform block
+  glm::mat4 VP = Matrices.projection * Matrices.view;
+  glBindBuffer (GL_UNIFORM_BUFFER, Matrices.CameraBuffer);
+  glBufferSubData (GL_UNIFORM_BUFFER, 0, 16*sizeof(GLfloat), &VP[0][0]);
+}
+
+/* Set the model transform applied in the vertex shader - the object is
+   scaled along x and rotated about the pivot, then moved by the offset */
+void setModelTransform (float offsetX, float offsetY, float angle = 0, float pivotX = 0, float pivotY = 0, float scaleX = 1)
+{
+  glUniform4f(Matrices.TransformID, offsetX, offsetY, angle, scaleX);
+  glUniform2f(Matrices.PivotID, pivotX, pivotY);
+}
 
 void zoomIn()
 {
@@ -310,138 +471,100 @@ void panRight()
   displayLeft = displayRight - temp;
 }
 
-/* Executed when a regular key is pressed/released/held-down */
-/* Prefered for Keyboard events */
-void keyboard (GLFWwindow* window, int key, int scancode, int action, int mods)
+/* Queue an input event. x and y are the cursor in window coordinates and are
+   handed on in game coordinates */
+void pushInput (InputType type, int code, bool pressed, double x, double y)
 {
-  // Function is called first on GLFW_PRESS.
-  if (action == GLFW_RELEASE) {
-    keyStates[key] = false;
+  unsigned head = inputQueue.head.load(memory_order_relaxed);
+  InputEvent *event = &inputQueue.events[head & (INPUT_QUEUE_SIZE - 1)];
+
+  if(head - inputQueue.tail.load(memory_order_acquire) == INPUT_QUEUE_SIZE)
+  {
+    inputQueue.dropped++;
+    return;
   }
-  else if (action == GLFW_PRESS) {
-    keyStates[key] = true;
-    switch (key) {
-        case GLFW_KEY_I:
-            updateTime = max(updateTime - 0.25, 0.25);
-            break;
-        case GLFW_KEY_O:
-            updateTime = min(updateTime + 0.25, 1.75);
-            break;
-        case GLFW_KEY_N:
-            speed = min(speed + 0.01, 0.1);
-            break;
-        case GLFW_KEY_M:
-            speed = max(speed - 0.001, 0.001);
-            break;
-        case GLFW_KEY_Q:
-            quit(window);
-            break;
-        default:
-            break;
-    }
+
+  event->time = inputClock();
+  event->type = type;
+  event->code = code;
+  event->pressed = pressed;
+  event->x = (x*2*screenRightX/1100) - screenRightX;
+  event->y = screenTopY - (y*2*screenTopY/600);
+  inputQueue.head.store(head + 1, memory_order_release);
+}
+
+/* The game key a GLFW key stands for, or -1 when the game ignores it */
+int gameKey (int key)
+{
+  switch (key) {
+      case GLFW_KEY_LEFT: return GAME_KEY_LEFT;
+      case GLFW_KEY_RIGHT: return GAME_KEY_RIGHT;
+      case GLFW_KEY_LEFT_ALT: return GAME_KEY_LEFT_ALT;
+      case GLFW_KEY_RIGHT_ALT: return GAME_KEY_RIGHT_ALT;
+      case GLFW_KEY_LEFT_CONTROL: return GAME_KEY_LEFT_CONTROL;
+      case GLFW_KEY_RIGHT_CONTROL: return GAME_KEY_RIGHT_CONTROL;
+      case GLFW_KEY_A: return GAME_KEY_A;
+      case GLFW_KEY_D: return GAME_KEY_D;
+      case GLFW_KEY_S: return GAME_KEY_S;
+      case GLFW_KEY_F: return GAME_KEY_F;
+      case GLFW_KEY_SPACE: return GAME_KEY_SPACE;
+      case GLFW_KEY_I: return GAME_KEY_I;
+      case GLFW_KEY_O: return GAME_KEY_O;
+      case GLFW_KEY_N: return GAME_KEY_N;
+      case GLFW_KEY_M: return GAME_KEY_M;
+      default: return -1;
   }
 }
 
-void keyStateCheck()
+/* Executed when a regular key is pressed/released/held-down */
+/* Prefered for Keyboard events */
+void keyboard (GLFWwindow* window, int key, int scancode, int action, int mods)
 {
-  // Bucket Controls
-  if (keyStates[GLFW_KEY_LEFT])
-  {
-    if(keyStates[GLFW_KEY_LEFT_ALT] || keyStates[GLFW_KEY_RIGHT_ALT])
-    {
-      bucketInfo[0].topLeft = max(bucketInfo[0].topLeft-0.1, screenLeftX+1.0);
-      bucketInfo[0].topRight = bucketInfo[0].topLeft + 1.6;
-    }
-    else if(keyStates[GLFW_KEY_LEFT_CONTROL] || keyStates[GLFW_KEY_RIGHT_CONTROL])
-    {
-      bucketInfo[1].topLeft = max(bucketInfo[1].topLeft-0.1, screenLeftX+1.0);
-      bucketInfo[1].topRight = bucketInfo[1].topLeft + 1.6;
-    }
+  if (action == GLFW_REPEAT)
+    return;
 
-    // Pan Controls
-    else
-    {
-      panLeft();
-    }
+  if (key == GLFW_KEY_Q && action == GLFW_PRESS) {
+    quit(window);
+    return;
   }
-  if (keyStates[GLFW_KEY_RIGHT])
-  {
-    if(keyStates[GLFW_KEY_LEFT_ALT] || keyStates[GLFW_KEY_RIGHT_ALT])
-    {
-      bucketInfo[0].topRight = min(bucketInfo[0].topRight+0.1, screenRightX-7.0);
-      bucketInfo[0].topLeft = bucketInfo[0].topRight - 1.6;
-    }
-    else if(keyStates[GLFW_KEY_LEFT_CONTROL] || keyStates[GLFW_KEY_RIGHT_CONTROL])
-    {
-      bucketInfo[1].topRight = min(bucketInfo[1].topRight+0.1, screenRightX-7.0);
-      bucketInfo[1].topLeft = bucketInfo[1].topRight - 1.6;
-    }
+  if (gameKey(key) >= 0)
+    pushInput(INPUT_KEY, gameKey(key), action == GLFW_PRESS, 0, 0);
+}
 
-    // Pan Controls
-    else
-    {
-      panRight();
-    }
-  }
+/* Apply, in order, every queued event that happened by time */
+void drainInput (double time)
+{
+  unsigned tail = inputQueue.tail.load(memory_order_relaxed);
 
-  // Cannon Controls
-  if(keyStates[GLFW_KEY_A])
+  while(tail != inputQueue.head.load(memory_order_acquire) && inputQueue.events[tail & (INPUT_QUEUE_SIZE - 1)].time <= time)
   {
-    cannonInfo.angle = min(cannonInfo.angle+0.1, 45.0);
+    applyInput(&game, &inputQueue.events[tail & (INPUT_QUEUE_SIZE - 1)]);
+    inputQueue.tail.store(++tail, memory_order_release);
   }
+}
 
-  if(keyStates[GLFW_KEY_D])
-  {
-    cannonInfo.angle = max(cannonInfo.angle-0.1, -45.0);
-  }
-  if(keyStates[GLFW_KEY_S])
-  {
-    cannonInfo.y = min(cannonInfo.y+0.1, 3.5);
-    rayPoints[1] = cannonInfo.y;
-  }
-  if(keyStates[GLFW_KEY_F])
-  {
-    cannonInfo.y = max(cannonInfo.y-0.1, -3.5);
-    rayPoints[1] = cannonInfo.y;
-  }
+/* Pan and zoom only change what is drawn, so the render thread polls them itself */
+void viewKeyCheck (GLFWwindow* window)
+{
+  bool modifier = glfwGetKey(window, GLFW_KEY_LEFT_ALT) == GLFW_PRESS || glfwGetKey(window, GLFW_KEY_RIGHT_ALT) == GLFW_PRESS
+    || glfwGetKey(window, GLFW_KEY_LEFT_CONTROL) == GLFW_PRESS || glfwGetKey(window, GLFW_KEY_RIGHT_CONTROL) == GLFW_PRESS;
 
-  // Mouse Controls
-  if(keyStates[GLFW_MOUSE_BUTTON_LEFT])
+  // Pan Controls - arrows with Alt or Control move the buckets instead
+  if(!modifier && glfwGetKey(window, GLFW_KEY_LEFT) == GLFW_PRESS)
   {
-    glfwGetCursorPos(windowCopy, &mouseX, &mouseY);
-    mouseX = (mouseX*2*screenRightX/1100) - screenRightX;
-    mouseY = screenTopY - (mouseY*2*screenTopY/600);
-    // Mouse selection
-    checkAndSelect();
-    moveSelected();
+    panLeft();
   }
-
-  if(keyStates[GLFW_MOUSE_BUTTON_RIGHT])
+  if(!modifier && glfwGetKey(window, GLFW_KEY_RIGHT) == GLFW_PRESS)
   {
-    double tempX, tempY;
-    tempX = (mouseX*2*screenRightX/1100) - screenRightX;
-    tempY = screenTopY - (mouseY*2*screenTopY/600);
-    glfwGetCursorPos(windowCopy, &mouseX, &mouseY);
-    mouseX = (mouseX*2*screenRightX/1100) - screenRightX;
-    mouseY = screenTopY - (mouseY*2*screenTopY/600);
-
-    // Mouse selection
-    if(mouseX < tempX)
-    {
-      panLeft;
-    }
-    else if(mouseX > tempX)
-    {
-      panRight;
-    }
+    panRight();
   }
 
   // Zoom Controls
-  if(keyStates[GLFW_KEY_UP])
+  if(glfwGetKey(window, GLFW_KEY_UP) == GLFW_PRESS)
   {
     zoomIn();
   }
-  else if(keyStates[GLFW_KEY_DOWN])
+  else if(glfwGetKey(window, GLFW_KEY_DOWN) == GLFW_PRESS)
   {
     zoomOut();
   }
@@ -463,30 +586,20 @@ void keyboardChar (GLFWwindow* window, unsigned int key)
 /* Executed when a mouse button is pressed/released */
 void mouseButton (GLFWwindow* window, int button, int action, int mods)
 {
-  switch (button) {
-      case GLFW_MOUSE_BUTTON_LEFT:
-          if (action == GLFW_RELEASE) {
-              keyStates[button] = false;
-              resetMouseCoordinates();
-              resetSelectState();
-          }
-          else if (action == GLFW_PRESS) {
-              keyStates[button] = true;
-          }
-          break;
-        case GLFW_MOUSE_BUTTON_RIGHT:
-            if (action == GLFW_RELEASE) {
-                keyStates[button] = false;
-                resetMouseCoordinates();
-                resetSelectState();
-              }
-            else if (action == GLFW_PRESS) {
-                keyStates[button] = true;
-            }
-            break;
-      default:
-          break;
-  }
+  double x, y;
+
+  // GLFW numbers the left, right and middle buttons as the game does
+  if (button >= GAME_BUTTON_COUNT)
+    return;
+
+  glfwGetCursorPos(window, &x, &y);
+  pushInput(INPUT_MOUSE_BUTTON, button, action == GLFW_PRESS, x, y);
+}
+
+/* Executed when the cursor moves */
+void cursorPosition (GLFWwindow* window, double x, double y)
+{
+  pushInput(INPUT_CURSOR, 0, false, x, y);
 }
 
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
@@ -502,6 +615,8 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
 }
 
 void draw();
+void runFrameJobs();
+void fenceBlockInstances();
 /* Executed when window is resized to 'width' and 'height' */
 /* Modify the bounds of the screen here in glm::ortho or Field of View in glm::Perspective */
 void reshapeWindow (GLFWwindow* window, int width, int height)
@@ -514,172 +629,20 @@ void reshapeWindow (GLFWwindow* window, int width, int height)
     GLfloat fov = 90.0f;
     glEnable(GL_SCISSOR_TEST);
 
+    // Both viewports draw the blocks and score laid out here
+    runFrameJobs();
+
     glViewport ((GLsizei) (fbwidth - 300), 0, (GLsizei) fbwidth, (GLsizei) fbheight);
     glScissor((GLsizei) (fbwidth - 300), 0, (GLsizei) fbwidth, (GLsizei) fbheight);
-    Matrices.projection = glm::ortho(screenRightX - 6.0f, screenRightX*2.0f, screenBottomY, screenTopY, 0.1f, 500.0f);
+    setView(screenRightX - 6.0f, screenRightX*2.0f, screenBottomY, screenTopY);
     draw();
 
     glViewport (0, 0, (GLsizei) (fbwidth - 300), (GLsizei) fbheight);
     glScissor (0, 0, (GLsizei) (fbwidth - 300), (GLsizei) fbheight);
-    Matrices.projection = glm::ortho(displayLeft, displayRight, displayBottom, displayTop, 0.1f, 500.0f);
+    setView(displayLeft, displayRight, displayBottom, displayTop);
     draw();
-}
-
-void initialize()
-{
-  int i;
-
-  score = 0;
-  wrongHits = 0;
-  wrongCatch = 0;
-  srand((unsigned)time(0));
-
-  /* Initializing y - coordinates of all blocks to something outside range - Replaced by actual coordinates on creation */
-  for (i = 0; i < 5000; i++)
-  {
-    blockInfo[i].y = -100;
-    blockInfo[i].type = 0;
-  }
-
-  // Initializing the pressed state of all keys to false
-  for(i = 0; i < 500; i++)
-  {
-    keyStates[i] = false;
-  }
-
-  // Initializing the coordinates of all mirrors to something outside range - Replaced by actual coordinates on creation
-  for(i = 0; i < 5; i++)
-  {
-    mirrorInfo[i].x = -100;
-    mirrorInfo[i].y = -100;
-  }
-
-  cannonInfo.y = 0;
-  cannonInfo.angle = 0;
-
-  rayPoints[0] = screenLeftX;
-  rayPoints[1] = 0.0;
-
-  resetMouseCoordinates();
-  resetMirrors();
-  resetPotentialIntersections();
-  resetSelectState();
-}
-
-void checkAndSelect()
-{
-  int i, flag = 0;
-
-  if(selected)
-    return;
-
-  // Check if Bucket is selected
-  for(i = 0; i < 2; i++)
-  {
-    if(mouseY <= screenBottomY + 1.0 && screenBottomY <= mouseY)
-    {
-      float C1 = screenBottomY - mouseY + (mouseX - bucketInfo[i].bottomLeft)/(bucketInfo[i].topLeft - bucketInfo[i].bottomLeft);
-      float C2 = (bucketInfo[i].bottomRight - bucketInfo[i].bottomLeft)/(bucketInfo[i].topLeft - bucketInfo[i].bottomLeft);
-
-      float C3 = screenBottomY - mouseY + (mouseX - bucketInfo[i].bottomRight)/(bucketInfo[i].topRight - bucketInfo[i].bottomRight);
-      float C4 = (bucketInfo[i].bottomLeft - bucketInfo[i].bottomRight)/(bucketInfo[i].topRight - bucketInfo[i].bottomRight);
-
-      if(C1*C2 >= 0 && C3*C4 >= 0)
-      {
-        bucketInfo[i].selected = true;
-        selected = true;
-        flag++;
-        break;
-      }
-    }
-  }
-
-  // Check if Cannon is selected
-  if(flag == 0)
-  {
-    float Y2 = cannonInfo.y + cannonInfo.length*sin(cannonInfo.angle*M_PI/180.0);
-
-    if(mouseY <= max(cannonInfo.y, Y2) && min(cannonInfo.y, Y2) <= mouseY)
-    {
-      if(mouseX <= screenLeftX + cannonInfo.length*cos(cannonInfo.angle*M_PI/180.0))
-      {
-        cannonInfo.selected = true;
-        selected = true;
-      }
-    }
-  }
-}
-
-void resetMirrors ()
-{
-  int i;
-  for(i = 0; i < mirrorCount; i++)
-  {
-    mirrorInfo[i].intersectionX = 100;
-  }
-}
-
-void resetPotentialIntersections ()
-{
-  int i;
-  for(i = 0; i < mirrorCount; i++)
-  {
-    potentialIntersections[i].x = 100;
-    potentialIntersections[i].y = 100;
-  }
-}
-
-void resetMouseCoordinates()
-{
-  mouseX = 100.0;
-  mouseY = 100.0;
-}
-
-void resetSelectState()
-{
-  int i;
-
-  selected = false;
-
-  cannonInfo.selected = false;
-
-  for(i = 0; i < 2; i++)
-  {
-    bucketInfo[i].selected = false;
-  }
-}
-int getMin (Points arr[])
-{
-  int i, j = 0;
-  float x = 100.0, y = 100.0;
-
-  for(i = 0; i < mirrorCount; i++)
-  {
-    if(arr[i].x < x)
-    {
-      x = arr[i].x;
-      y = arr[i].y;
-      j = i;
-    }
-  }
-  return j;
-}
-
-int getMax (Points arr[])
-{
-  int i, j = 0;
-  float x = -100.0, y = -100.0;
 
-  for(i = 0; i < mirrorCount; i++)
-  {
-    if(arr[i].x > x && arr[i].x != 100.0)
-    {
-      x = arr[i].x;
-      y = arr[i].y;
-      j = i;
-    }
-  }
-  return j;
+    fenceBlockInstances();
 }
 
 // Creates the cannon that shoots the death ray
@@ -687,13 +650,13 @@ void createCannon ()
 {
 
   const GLfloat vertex_buffer_data [] = {
-    screenLeftX + cannonInfo.length, cannonInfo.thickness/2, 0, // vertex 1
-    screenLeftX, cannonInfo.thickness/2, 0, // vertex 2
-    screenLeftX, -cannonInfo.thickness/2, 0, // vertex 3
+    screenLeftX + Cannon::length, Cannon::thickness/2, 0, // vertex 1
+    screenLeftX, Cannon::thickness/2, 0, // vertex 2
+    screenLeftX, -Cannon::thickness/2, 0, // vertex 3
 
-    screenLeftX, -cannonInfo.thickness/2, 0, // vertex 3
-    screenLeftX + cannonInfo.length, -cannonInfo.thickness/2, 0, // vertex 4
-    screenLeftX + cannonInfo.length, cannonInfo.thickness/2, 0  // vertex 1
+    screenLeftX, -Cannon::thickness/2, 0, // vertex 3
+    screenLeftX + Cannon::length, -Cannon::thickness/2, 0, // vertex 4
+    screenLeftX + Cannon::length, Cannon::thickness/2, 0  // vertex 1
   };
 
   const GLfloat color_buffer_data [] = {
@@ -706,56 +669,65 @@ void createCannon ()
     255, 255, 255,  // color 1
   };
 
-  // create3DObject creates and returns a handle to a VAO that can be used later
-  cannon = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data, color_buffer_data, GL_FILL);
+  cannon = createStaticObject(GL_TRIANGLES, 6, vertex_buffer_data, color_buffer_data, GL_FILL);
 }
 
 // Creates the death ray that destroys the rogue blocks
-void createDeathRay (float startPointX, float startPointY, float endPointX, float endPointY, int val)
+void createDeathRay ()
 {
+  // Room for the longest ray path - segments are streamed in every frame the ray is fired
+  GLfloat vertex_buffer_data [6*MAX_RAY_SEGMENTS] = {0};
 
-  const GLfloat vertex_buffer_data [] = {
-    endPointX, endPointY, 0, // vertex 1
-    startPointX, startPointY, 0, // vertex 2
-  };
+  // create3DObject creates and returns a handle to a VAO that can be used later
+  deathRay = create3DObject(GL_LINES, 2*MAX_RAY_SEGMENTS, vertex_buffer_data, 255, 255, 255, GL_FILL);
+  deathRay->LineWidth = 12.5;
+}
 
-  const GLfloat color_buffer_data [] = {
-    255, 255, 255, // color 1
-    255, 255, 255, // color 2
-  };
+// Uploads the visible part of the death ray path and draws it with a single call
+void drawDeathRay ()
+{
+  int i, count = 0;
+  GLfloat visibleData[6*MAX_RAY_SEGMENTS];
 
-  // create3DObject creates and returns a handle to a VAO that can be used later
-  deathRay[val] = create3DObject(GL_LINES, 2, vertex_buffer_data, color_buffer_data, GL_FILL);
+  for(i = 0; i < scene->raySegmentCount; i++)
+  {
+    GLfloat *segment = &scene->rayVertexData[6*i];
+    if(isVisible(min(segment[0], segment[3]), max(segment[0], segment[3]), min(segment[1], segment[4]), max(segment[1], segment[4])))
+    {
+      memcpy(&visibleData[6*count++], segment, 6*sizeof(GLfloat));
+    }
+  }
+
+  if(count == 0)
+    return;
+
+  streamBufferData(deathRay->VertexBuffer, sizeof(scene->rayVertexData), 6*count*sizeof(GLfloat), visibleData);
+
+  deathRay->NumVertices = 2*count;
+  draw3DObject(deathRay);
 }
 
-// Creates the mirror objects that reflect the death ray
+// Creates the mirror objects that reflect the death ray, wherever the game placed them
 void createMirrors ()
 {
 
   int i;
+  const Mirror *mirrorInfo = game.mirrorInfo;
 
-  mirrorCount = rand()%3 + 3;
-
-  for(i = 0; i < mirrorCount; i++)
+  for(i = 0; i < game.mirrorCount; i++)
   {
-    mirrorInfo[i].x = -6.94 + static_cast <float> (rand()) /( static_cast <float> (RAND_MAX/(8.94)));
-    mirrorInfo[i].y = -2.94 + static_cast <float> (rand()) /( static_cast <float> (RAND_MAX/(5.94)));
-    mirrorInfo[i].angle = (1.0f + static_cast <float> (rand()) /( static_cast <float> (RAND_MAX/(88.0f))));
-    mirrorInfo[i].length = min(4.0, (screenRightX - 6.0 - mirrorInfo[i].x)/cos(mirrorInfo[i].angle*M_PI/180.0f));
-
     // GL3 accepts only Triangles. Quads are not supported
     const GLfloat vertex_buffer_data [] = {
       mirrorInfo[i].x, mirrorInfo[i].y, 0, // vertex 1
-      mirrorInfo[i].x + mirrorInfo[i].length*cos(mirrorInfo[i].angle*M_PI/180.0f), mirrorInfo[i].y + mirrorInfo[i].length*sin(mirrorInfo[i].angle*M_PI/180.0f), 0, // vertex 2
+      mirrorInfo[i].x2, mirrorInfo[i].y2, 0, // vertex 2
     };
     const GLfloat color_buffer_data [] = {
       255, 255, 255, // color 1
       255, 255, 255, // color 2
     };
 
-    glLineWidth(12.5);
-    // create3DObject creates and returns a handle to a VAO that can be used later
-    mirrors[i] = create3DObject(GL_LINES, 2, vertex_buffer_data, color_buffer_data, GL_FILL);
+    mirrors[i] = createStaticObject(GL_LINES, 2, vertex_buffer_data, color_buffer_data, GL_FILL);
+    mirrors[i]->LineWidth = 12.5;
   }
 }
 
@@ -784,8 +756,7 @@ void createBattery ()
     255 , 255, 255
   };
 
-  // create3DObject creates and returns a handle to a VAO that can be used later
-  battery = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data1, color_buffer_data1, GL_LINE);
+  battery = createStaticObject(GL_TRIANGLES, 6, vertex_buffer_data1, color_buffer_data1, GL_LINE);
 
   // GL3 accepts only Triangles. Quads are not supported
   const GLfloat vertex_buffer_data2 [] = {
@@ -808,16 +779,17 @@ void createBattery ()
     255 , 255, 255
   };
 
-  // create3DObject creates and returns a handle to a VAO that can be used later
-  batteryTip = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data2, color_buffer_data2, GL_FILL);
+  batteryTip = createStaticObject(GL_TRIANGLES, 6, vertex_buffer_data2, color_buffer_data2, GL_FILL);
 
-    // GL3 accepts only Triangles. Quads are not supported
+  /* Charge bar is one unit wide - draw() stretches it to the current charge
+     with the x scale of the transform uniform, so the geometry never has to be rebuilt */
+  // GL3 accepts only Triangles. Quads are not supported
   const GLfloat vertex_buffer_data3 [] = {
     juiceStartX, juiceStartY, 0,
-    juiceEndX, juiceStartY, 0,
-    juiceEndX, juiceEndY, 0,
+    juiceStartX + 1.0, juiceStartY, 0,
+    juiceStartX + 1.0, juiceEndY, 0,
 
-    juiceEndX, juiceEndY, 0,
+    juiceStartX + 1.0, juiceEndY, 0,
     juiceStartX, juiceEndY, 0,
     juiceStartX, juiceStartY, 0,
    };
@@ -831,35 +803,31 @@ void createBattery ()
     0.0, 255, 0.0
   };
 
-  batteryStatus = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data3, color_buffer_data3, GL_FILL);
+  batteryStatus = createStaticObject(GL_TRIANGLES, 6, vertex_buffer_data3, color_buffer_data3, GL_FILL);
 
 }
 
-// Creates the Buckets used to catch the falling Blocks
+// Creates the Buckets used to catch the falling Blocks, where the game starts them
 void createBuckets ()
 {
   int i;
-  float r = 255, g = 0, initLoc = -4.5;
+  float r = 255, g = 0;
 
   for(i = 0; i < 2; i++)
   {
+    const Bucket &b = game.bucketInfo[i];
+
     // GL3 accepts only Triangles. Quads are not supported
     const GLfloat vertex_buffer_data [] = {
-      initLoc - 0.3, screenBottomY, 0, // vertex 1
-      initLoc + 0.3, screenBottomY, 0, // vertex 2
-      initLoc + 0.8, screenBottomY + 1.0, 0, // vertex 3
+      b.bottomLeft, screenBottomY, 0, // vertex 1
+      b.bottomRight, screenBottomY, 0, // vertex 2
+      b.topRight, screenBottomY + 1.0, 0, // vertex 3
 
-      initLoc + 0.8, screenBottomY + 1.0, 0, // vertex 3
-      initLoc - 0.8, screenBottomY + 1.0, 0, // vertex 4
-      initLoc - 0.3, screenBottomY, 0  // vertex 1
+      b.topRight, screenBottomY + 1.0, 0, // vertex 3
+      b.topLeft, screenBottomY + 1.0, 0, // vertex 4
+      b.bottomLeft, screenBottomY, 0  // vertex 1
     };
 
-    bucketInfo[i].topLeft = initLoc - 0.8;
-    bucketInfo[i].topRight = initLoc + 0.8;
-    bucketInfo[i].bottomLeft = initLoc - 0.3;
-    bucketInfo[i].bottomRight = initLoc + 0.3;
-    bucketInfo[i].initLeft = bucketInfo[i].topLeft;
-
     const GLfloat color_buffer_data [] = {
       r, g, 0, // color 1
       r, g, 0, // color 2
@@ -870,100 +838,118 @@ void createBuckets ()
       r, g, 0  // color 1
     };
 
-    // create3DObject creates and returns a handle to a VAO that can be used later
-    bucket[i] = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data, color_buffer_data, GL_FILL);
+    bucket[i] = createStaticObject(GL_TRIANGLES, 6, vertex_buffer_data, color_buffer_data, GL_FILL);
 
     r = 0;
     g = 255;
-    initLoc = -1.5;
   }
 }
 
-// Creates the block objects that fall from top
-void createBlocks ()
+/* Size the instance buffer for capacity blocks. The persistent buffer is
+   immutable, so it is replaced outright once the GPU is done with every
+   region. Expects the block VAO to be bound */
+void resizeBlockInstances (int capacity)
 {
+  int i;
 
-  int i, type;
-  float xval, r, g, b;
+  blockInstanceCapacity = capacity;
+  blockInstanceData = (GLfloat*) realloc(blockInstanceData, 3*capacity*sizeof(GLfloat));
 
-  for(i = 0; i < 5000; i++)
+  if(GLAD_GL_VERSION_4_4 || GLAD_GL_ARB_buffer_storage)
   {
-    r = 255, g = 0, b = 0;
-    xval = -5.94 + static_cast <float> (rand()) /( static_cast <float> (RAND_MAX/(9.44)));
-    blockInfo[i].x = xval;
-    blockInfo[i].initY = 5.7;
-    type = rand()%3;
-    if(type == 1)
-    {
-      r = 0, g = 255;
-      blockInfo[i].type = 1;
-    }
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
 
-    else if(type == 2)
+    if(blockInstanceMap)
     {
-      r = 0, g = 191, b = 255;
-      blockInfo[i].type = 2;
+      for(i = 0; i < INSTANCE_REGIONS; i++)
+      {
+        if(blockInstanceFence[i])
+        {
+          while(glClientWaitSync(blockInstanceFence[i], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED);
+          glDeleteSync(blockInstanceFence[i]);
+          blockInstanceFence[i] = 0;
+        }
+      }
+      glBindBuffer (GL_ARRAY_BUFFER, blockInstanceBuffer);
+      glUnmapBuffer (GL_ARRAY_BUFFER);
+      glDeleteBuffers (1, &blockInstanceBuffer);
+      glGenBuffers (1, &blockInstanceBuffer);
     }
-    // GL3 accepts only Triangles. Quads are not supported
-    const GLfloat vertex_buffer_data [] = {
-      -0.05, 5.7, 0, // vertex 1
-      +0.05, 5.7, 0, // vertex 2
-      +0.05, 6, 0, // vertex 3
+    glBindBuffer (GL_ARRAY_BUFFER, blockInstanceBuffer);
+    glBufferStorage (GL_ARRAY_BUFFER, INSTANCE_REGIONS*3*capacity*sizeof(GLfloat), NULL, flags);
+    blockInstanceMap = (GLfloat*) glMapBufferRange(GL_ARRAY_BUFFER, 0, INSTANCE_REGIONS*3*capacity*sizeof(GLfloat), flags);
+  }
+  else
+  {
+    glBindBuffer (GL_ARRAY_BUFFER, blockInstanceBuffer);
+    glBufferData (GL_ARRAY_BUFFER, 3*capacity*sizeof(GLfloat), NULL, GL_STREAM_DRAW);
+  }
+}
 
-      +0.05, 6, 0, // vertex 3
-      -0.05 , 6, 0, // vertex 4
-      -0.05, 5.7, 0  // vertex 1
-    };
+// Creates the block objects that fall from top
+void createBlocks ()
+{
 
-    const GLfloat color_buffer_data [] = {
-      r, g, b, // color 1
-      r, g, b, // color 2
-      r, g, b, // color 3
+  // One quad shared by all blocks - position and colour come from the instance buffer
+  // GL3 accepts only Triangles. Quads are not supported
+  const GLfloat vertex_buffer_data [] = {
+    -0.05, 5.7, 0, // vertex 1
+    +0.05, 5.7, 0, // vertex 2
+    +0.05, 6, 0, // vertex 3
 
-      r, g, b, // color 3
-      r, g, b, // color 4
-      r, g, b, // color 1
-    };
+    +0.05, 6, 0, // vertex 3
+    -0.05 , 6, 0, // vertex 4
+    -0.05, 5.7, 0  // vertex 1
+  };
 
-    // create3DObject creates and returns a handle to a VAO that can be used later
-    blocks[i] = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data, color_buffer_data, GL_FILL);
-  }
+  // create3DObject creates and returns a handle to a VAO that can be used later
+  blockQuad = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data, 255, 255, 255, GL_FILL);
+
+  glGenBuffers (1, &blockInstanceBuffer); // VBO - per block (x, y, type)
+  resizeBlockInstances (game.blocks.capacity);
+  glVertexAttribPointer(
+                        2,                  // attribute 2. Block instance
+                        3,                  // size (x,y,type)
+                        GL_FLOAT,           // type
+                        GL_FALSE,           // normalized?
+                        0,                  // stride
+                        (void*)0            // array buffer offset
+                        );
+  glEnableVertexAttribArray(2);
+  glVertexAttribDivisor(2, 1); // Advance once per block, not once per vertex
 }
 
 // Creates the score tiles for seven segment display
 void createScoreTile ()
 {
-  int i, j;
+  // One tile shared by every segment of every digit
+  // GL3 accepts only Triangles. Quads are not supported
+  const GLfloat tile_buffer_data [] = {
+    -0.05, 0, 0, // vertex 1
+    +0.05, 0, 0, // vertex 2
+    +0.05, 1, 0, // vertex 3
+
+    +0.05, 1, 0, // vertex 3
+    -0.05 , 1, 0, // vertex 4
+    -0.05, 0, 0  // vertex 1
+  };
 
-  for(i = 0; i < 3; i++)
-  {
-    for(j = 0; j < 7; j++)
-    {
-      // GL3 accepts only Triangles. Quads are not supported
-      const GLfloat vertex_buffer_data [] = {
-        -0.05, 0, 0, // vertex 1
-        +0.05, 0, 0, // vertex 2
-        +0.05, 1, 0, // vertex 3
-
-        +0.05, 1, 0, // vertex 3
-        -0.05 , 1, 0, // vertex 4
-        -0.05, 0, 0  // vertex 1
-      };
-
-      const GLfloat color_buffer_data [] = {
-        255, 255, 255, // color 1
-        255, 255, 255, // color 2
-        255, 255, 255, // color 3
-
-        255, 255, 255, // color 3
-        255, 255, 255, // color 4
-        255, 255, 255, // color 1
-      };
-
-      // create3DObject creates and returns a handle to a VAO that can be used later
-      scoreTile[i][j] = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data, color_buffer_data, GL_FILL);
-    }
-  }
+  // create3DObject creates and returns a handle to a VAO that can be used later
+  scoreTile = create3DObject(GL_TRIANGLES, 6, tile_buffer_data, 255, 255, 255, GL_FILL);
+
+  glGenBuffers (1, &segmentInstanceBuffer); // VBO - per segment (x, y, horizontal)
+  glBindBuffer (GL_ARRAY_BUFFER, segmentInstanceBuffer);
+  glBufferData (GL_ARRAY_BUFFER, sizeof(segmentInstanceData), NULL, GL_STREAM_DRAW);
+  glVertexAttribPointer(
+                        2,                  // attribute 2. Segment instance
+                        3,                  // size (x,y,horizontal)
+                        GL_FLOAT,           // type
+                        GL_FALSE,           // normalized?
+                        0,                  // stride
+                        (void*)0            // array buffer offset
+                        );
+  glEnableVertexAttribArray(2);
+  glVertexAttribDivisor(2, 1); // Advance once per segment, not once per vertex
 
   const GLfloat vertex_buffer_data [] = {
     screenRightX - 6.0, screenBottomY, 0, // vertex 1
@@ -985,492 +971,278 @@ void createScoreTile ()
     102, 0, 51, // color 1
   };
 
-  scoreBackground = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data, color_buffer_data, GL_FILL);
+  scoreBackground = createStaticObject(GL_TRIANGLES, 6, vertex_buffer_data, color_buffer_data, GL_FILL);
 }
 
-void insertBlock()
-{
-  int i;
+// Placement of the seven segments in a digit - offset from the digit origin and whether the tile lies flat
+static const GLfloat segmentLayout[7][3] = {
+  {0.0, 0.0, 1},   // bottom
+  {-0.05, 0.1, 0}, // lower left
+  {0.0, 1.1, 1},   // middle
+  {1.05, 0.1, 0},  // lower right
+  {-0.05, 1.2, 0}, // upper left
+  {0.0, 2.2, 1},   // top
+  {1.05, 1.2, 0}   // upper right
+};
 
-  /* Checking if there is any slot left for block creation */
-  for(i = 0; i < 5000; i++)
-  {
-    if(blockInfo[i].y == -100)
-    {
-      blockInfo[i].y = 0;
-      blockInfo[i].x = -5.94 + static_cast <float> (rand()) /( static_cast <float> (RAND_MAX/(9.44)));
-      break;
-    }
-  }
-}
+// Lit segments of each decimal digit - bit j is set when segment j is on
+static const int segmentMask[10] = {123, 72, 103, 109, 92, 61, 63, 104, 127, 125};
+
+int scoreSegmentCount;
+float scoreScale;
 
-void moveSelected()
+/* Lay out the lit segments of the score, once a frame. At least 3 digits
+   are shown - longer scores shrink to fit the score board */
+void layoutScore (Job *job)
 {
-  int i;
-  float temp;
+  int i, j, digits = 0, count = 0, temp = scene->score;
+  float scale, originX;
 
-  // Move selected bucket
-  for(i = 0; i < 2; i++)
+  do
+  {
+    digits++;
+    temp /= 10;
+  } while(temp > 0);
+  digits = max(digits, 3);
+  scale = min(1.0f, 3.0f/digits);
+
+  temp = scene->score;
+  for(i = 0; i < digits; i++)
   {
-    if(bucketInfo[i].selected)
+    // Right edge of the lowest digit stays put, the rest are laid out to its left
+    originX = 9.35f - scale*(1.1f + 1.5f*i);
+    for(j = 0; j < 7; j++)
     {
-      bucketInfo[i].topLeft = max(mouseX, screenLeftX + 1.0);
-      if(bucketInfo[i].topLeft > 0)
+      if(segmentMask[temp%10] & (1 << j))
       {
-        bucketInfo[i].topLeft = min(mouseX, screenRightX - 8.6);
+        segmentInstanceData[3*count] = originX + scale*segmentLayout[j][0];
+        segmentInstanceData[3*count + 1] = scale*segmentLayout[j][1];
+        segmentInstanceData[3*count + 2] = segmentLayout[j][2];
+        count++;
       }
-      bucketInfo[i].topRight = bucketInfo[i].topLeft + 1.6;
-      return;
     }
+    temp /= 10;
   }
+  scoreSegmentCount = count;
+  scoreScale = scale;
+}
 
-  // Move selected Cannon
-  if(cannonInfo.selected)
-  {
-    cannonInfo.y = max(mouseY, -3.5);
-    cannonInfo.y = min(mouseY, 3.5);
-    rayPoints[1] = cannonInfo.y;
+/* Draw the score as a seven segment display with a single instanced call */
+void drawScore()
+{
+  if(!isVisible(scoreLeftX, scoreRightX, screenBottomY, screenTopY))
     return;
-  }
 
-  temp = atan2((mouseY - cannonInfo.y) , (mouseX - screenLeftX))*180.0f/M_PI;
-  cannonInfo.angle = min(temp, 45.0f);
-  if(cannonInfo.angle < 0)
-  {
-    cannonInfo.angle = max(temp, -45.0f);
-  }
+  useProgram (segmentProgramID);
+  glUniform1f(segmentScaleID, scoreScale);
+
+  streamBufferData(segmentInstanceBuffer, sizeof(segmentInstanceData), 3*scoreSegmentCount*sizeof(GLfloat), segmentInstanceData);
+
+  setPolygonMode (scoreTile->FillMode);
+  bindVertexArray (scoreTile->VertexArrayID);
+  glDrawArraysInstanced(scoreTile->PrimitiveMode, 0, scoreTile->NumVertices, scoreSegmentCount);
+
+  useProgram (programID);
 }
 
-float camera_rotation_angle = 90;
+GLfloat *blockInstanceTarget; // Where this frame's instances are written
 
-void drawNumber(int Number, int index)
+/* Pick the instance storage for this frame - the next region of the
+   persistent buffer once the GPU is done with it, or the CPU copy */
+void beginBlockInstances ()
 {
-  Matrices.view = glm::lookAt(glm::vec3(0,0,3), glm::vec3(0,0,0), glm::vec3(0,1,0)); // Fixed camera for 2D (ortho) in XY plane
-  glm::mat4 VP = Matrices.projection * Matrices.view;
-  glm::mat4 MVP;	// MVP = Projection * View * Model
-  glm::mat4 rotateTile = glm::rotate((float)(-90.0f*M_PI/180.0f), glm::vec3(0,0,1));
-
-  if(Number != 1 && Number != 4 && Number != 7)
+  // Follow the block pool when it has grown since the last frame
+  if(scene->capacity > blockInstanceCapacity)
   {
-    Matrices.model = glm::mat4(1.0f);
-    glm::mat4 translateTile = glm::translate (glm::vec3(8.25 - (float)index - 0.5f*index, 0.0f, 0.0f)); // glTranslatef
-    Matrices.model *= translateTile*rotateTile;
-    MVP = VP * Matrices.model; // MVP = p * V * M
-    glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-    draw3DObject(scoreTile[index][0]);
+    bindVertexArray (blockQuad->VertexArrayID);
+    resizeBlockInstances (scene->capacity);
   }
 
-  if(Number == 0 || Number == 2 || Number == 6 || Number == 8)
+  blockInstanceTarget = blockInstanceData;
+  if(blockInstanceMap)
   {
-    Matrices.model = glm::mat4(1.0f);
-    glm::mat4 translateTile = glm::translate (glm::vec3(8.25 - (float)index - 0.5f*index - 0.05f, 0.1f, 0.0f)); // glTranslatef
-    Matrices.model *= translateTile;
-    MVP = VP * Matrices.model; // MVP = p * V * M
-    glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-    draw3DObject(scoreTile[index][1]);
-  }
+    blockInstanceRegion = (blockInstanceRegion + 1) % INSTANCE_REGIONS;
 
-  if(Number != 0 && Number != 1 && Number != 7)
-  {
-    Matrices.model = glm::mat4(1.0f);
-    glm::mat4 translateTile = glm::translate (glm::vec3(8.25 - (float)index - 0.5f*index, 1.1f, 0.0f)); // glTranslatef
-    Matrices.model *= translateTile*rotateTile;
-    MVP = VP * Matrices.model; // MVP = p * V * M
-    glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-    draw3DObject(scoreTile[index][2]);
+    // Wait until the GPU has finished reading this region three frames ago
+    if(blockInstanceFence[blockInstanceRegion])
+    {
+      while(glClientWaitSync(blockInstanceFence[blockInstanceRegion], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED);
+      glDeleteSync(blockInstanceFence[blockInstanceRegion]);
+      blockInstanceFence[blockInstanceRegion] = 0;
+    }
+    blockInstanceTarget = blockInstanceMap + blockInstanceRegion*3*blockInstanceCapacity;
   }
+}
 
-  if(Number != 2)
-  {
-    Matrices.model = glm::mat4(1.0f);
-    glm::mat4 translateTile = glm::translate (glm::vec3(8.25 - (float)index - 0.5f*index + 1.05f, 0.1f, 0.0f)); // glTranslatef
-    Matrices.model *= translateTile;
-    MVP = VP * Matrices.model; // MVP = p * V * M
-    glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-    draw3DObject(scoreTile[index][3]);
-  }
+/* Write the blocks inside the game area into this frame's instance storage.
+   No GL calls, so it can run on any thread */
+void fillBlockInstances (Job *job)
+{
+  int i;
+  GLfloat *data = blockInstanceTarget;
 
-  if(Number != 1 && Number != 2 && Number != 3 && Number != 7)
+  blockInstanceCount = 0;
+  blocksCulled = 0;
+  for(i = 0; i < scene->count; i++)
   {
-    Matrices.model = glm::mat4(1.0f);
-    glm::mat4 translateTile = glm::translate (glm::vec3(8.25 - (float)index - 0.5f*index - 0.05f, 1.2f, 0.0f)); // glTranslatef
-    Matrices.model *= translateTile;
-    MVP = VP * Matrices.model; // MVP = p * V * M
-    glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-    draw3DObject(scoreTile[index][4]);
+    /* Skip blocks outside the zoomed and panned game area. Only the game
+       viewport is culled against - the score viewport starts right of where
+       any block can be, so drawBlocks() leaves it out altogether */
+    if(scene->x[i] + blockHalfWidth < displayLeft || scene->x[i] - blockHalfWidth > displayRight
+    || blockInitY + scene->y[i] + 0.3 < displayBottom || blockInitY + scene->y[i] > displayTop)
+    {
+      blocksCulled++;
+      continue;
+    }
+
+    data[3*blockInstanceCount] = scene->x[i];
+    data[3*blockInstanceCount + 1] = scene->y[i];
+    data[3*blockInstanceCount + 2] = scene->type[i];
+    blockInstanceCount++;
   }
+  blocksSubmitted = blockInstanceCount;
+  totalBlocksSubmitted += blocksSubmitted;
+  totalBlocksCulled += blocksCulled;
+  framesDrawn++;
+}
 
-  if(Number != 1 && Number != 4)
+/* Point the block VAO at this frame's instances */
+void endBlockInstances ()
+{
+  bindVertexArray (blockQuad->VertexArrayID);
+  glBindBuffer (GL_ARRAY_BUFFER, blockInstanceBuffer);
+  if(blockInstanceMap)
   {
-    Matrices.model = glm::mat4(1.0f);
-    glm::mat4 translateTile = glm::translate (glm::vec3(8.25 - (float)index - 0.5f*index, 2.20f, 0.0f)); // glTranslatef
-    Matrices.model *= translateTile*rotateTile;
-    MVP = VP * Matrices.model; // MVP = p * V * M
-    glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-    draw3DObject(scoreTile[index][5]);
+    // Point the instance attribute at this frame's region
+    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 0, (void*)(blockInstanceRegion*3*blockInstanceCapacity*sizeof(GLfloat)));
   }
-
-  if(Number != 5 && Number != 6)
+  else
   {
-    Matrices.model = glm::mat4(1.0f);
-    glm::mat4 translateTile = glm::translate (glm::vec3(8.25 - (float)index - 0.5f*index + 1.05f, 1.2f, 0.0f)); // glTranslatef
-    Matrices.model *= translateTile;
-    MVP = VP * Matrices.model; // MVP = p * V * M
-    glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-    draw3DObject(scoreTile[index][6]);
+    streamBufferData(blockInstanceBuffer, 3*blockInstanceCapacity*sizeof(GLfloat), 3*blockInstanceCount*sizeof(GLfloat), blockInstanceData);
   }
 }
 
-void drawScore()
+/* The CPU side of a frame as a task graph on the job system. Filling the
+   block instances and laying out the score are independent, so they run side
+   by side; GL calls stay on the render thread before and after the graph.
+   Those two are the only frame work big enough to be worth a job - the rest
+   is culling five mirrors and at most MAX_RAY_SEGMENTS ray segments against
+   the current viewport, which costs less than handing it to a worker would */
+long frameGraphs;
+double frameCriticalPath, frameGraphTime;
+JobStat statBlockInstances, statScore;
+
+void runFrameJobs ()
+{
+  Job blockJob, scoreJob, frameJob;
+  double start;
+
+  beginBlockInstances();
+
+  initJob(&blockJob, fillBlockInstances, statBlockInstances);
+  initJob(&scoreJob, layoutScore, statScore);
+  initJob(&frameJob, NULL, STAT_NONE);
+  addDependency(&blockJob, &frameJob);
+  addDependency(&scoreJob, &frameJob);
+
+  start = inputClock();
+  submitJob(&blockJob);
+  submitJob(&scoreJob);
+  submitJob(&frameJob);
+  waitForJob(&frameJob);
+
+  // The join's chain is the critical path through the graph
+  frameGraphs++;
+  frameCriticalPath += frameJob.chain;
+  frameGraphTime += frameJob.finish - start;
+
+  endBlockInstances();
+}
+
+/* Mark the current region as in use until the GPU has drawn this frame */
+void fenceBlockInstances ()
 {
-  int i, temp = score;
-  for(i = 0; i < 3; i++)
+  if(blockInstanceMap)
   {
-    drawNumber(temp%10, i);
-    temp /= 10;
+    blockInstanceFence[blockInstanceRegion] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
   }
 }
 
+/* Draw every live block with a single instanced call */
+void drawBlocks ()
+{
+  // Every uploaded block lies inside both the game area and the band blocks spawn in
+  if(blockInstanceCount == 0 || !isVisible(max(displayLeft, blockSpawnLeftX - blockHalfWidth), min(displayRight, blockSpawnRightX + blockHalfWidth),
+    displayBottom, displayTop))
+    return;
+
+  useProgram (blockProgramID);
+
+  setPolygonMode (blockQuad->FillMode);
+  bindVertexArray (blockQuad->VertexArrayID);
+  glDrawArraysInstanced(blockQuad->PrimitiveMode, 0, blockQuad->NumVertices, blockInstanceCount);
+
+  useProgram (programID);
+}
+
 /* Render the scene with openGL */
 /* Edit this function according to your assignment */
 void draw ()
 {
 
-  int i, flag = 0, j = 0, temp;
-  float tempX, rayAngle, initRayX, initRayY, slopeRay, slopeMirror, cRay, cMirror, rayX2, rayY2, x2, y2, yIntercept, xIntercept;
+  int i;
   // clear the color and depth in the frame buffer
   glClear (GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
   // use the loaded shader program
   // Don't change unless you know what you are doing
-  glUseProgram (programID);
-
-  // Eye - Location of camera. Don't change unless you are sure!!
-  glm::vec3 eye ( 5*cos(camera_rotation_angle*M_PI/180.0f), 0, 5*sin(camera_rotation_angle*M_PI/180.0f) );
-  // Target - Where is the camera looking at.  Don't change unless you are sure!!
-  glm::vec3 target (0, 0, 0);
-  // Up - Up vector defines tilt of camera.  Don't change unless you are sure!!
-  glm::vec3 up (0, 1, 0);
-
-  // Compute Camera matrix (view)
-  // Matrices.view = glm::lookAt( eye, target, up ); // Rotating Camera for 3D
-  //  Don't change unless you are sure!!
-  Matrices.view = glm::lookAt(glm::vec3(0,0,3), glm::vec3(0,0,0), glm::vec3(0,1,0)); // Fixed camera for 2D (ortho) in XY plane
-
-  // Compute ViewProject matrix as view/camera might not be changed for this frame (basic scenario)
-  //  Don't change unless you are sure!!
-  glm::mat4 VP = Matrices.projection * Matrices.view;
-
-  // Send our transformation to the currently bound shader, in the "MVP" uniform
-  // For each model you render, since the MVP will be different (at least the M part)
-  //  Don't change unless you are sure!!
-  glm::mat4 MVP;	// MVP = Projection * View * Model
+  useProgram (programID);
 
   /* Render your scene */
-  createBattery ();
-
-  Matrices.model = glm::mat4(1.0f);
-  MVP = VP * Matrices.model; // MVP = p * V * M
-  glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
+  // The view-projection matrix is already in the camera UBO - only model transforms are set here
+  setModelTransform(0, 0);
   draw3DObject(battery);
-  draw3DObject(batteryTip);
+  struct VAO* hud[] = {batteryTip, scoreBackground};
+  draw3DObjects(hud, 2);
+
+  // Stretch the unit charge bar to the amount of juice left
+  setModelTransform(0, 0, 0, juiceStartX, 0, scene->juiceEndX - juiceStartX);
   draw3DObject(batteryStatus);
 
-  draw3DObject(scoreBackground);
   drawScore();
 
   // Draw Buckets
   for(i = 0; i < 2; i++)
   {
-    // Load identity to model matrix
-    Matrices.model = glm::mat4(1.0f);
-
-    glm::mat4 translateBucket = glm::translate (glm::vec3(bucketInfo[i].topLeft - bucketInfo[i].initLeft, 0.0f, 0.0f)); // glTranslatef
-    Matrices.model *= translateBucket;
-    MVP = VP * Matrices.model; // MVP = p * V * M
-    glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-
+    setModelTransform(scene->bucketOffset[i], 0);
     draw3DObject(bucket[i]);
   }
 
   // Draw Blocks
-  for(i = 0; i < 5000; i++)
-  {
-    // Load identity to model matrix
-    Matrices.model = glm::mat4(1.0f);
-
-    if(blockInfo[i].y >= -12)
-    {
-      glm::mat4 translateBlock = glm::translate (glm::vec3(blockInfo[i].x, blockInfo[i].y, 0.0f)); // glTranslatef
-      Matrices.model *= translateBlock;
-      MVP = VP * Matrices.model; // MVP = p * V * M
-      glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-      draw3DObject(blocks[i]);
-      blockInfo[i].y -= speed;
-    }
-  }
+  drawBlocks();
 
   // Draw Mirrors
-  for(i = 0; i < mirrorCount; i++)
+  struct VAO* visibleMirrors[5];
+  int visibleCount = 0;
+  for(i = 0; i < game.mirrorCount; i++)
   {
-    // Load identity to model matrix
-    Matrices.model = glm::mat4(1.0f);
-
-    MVP = VP * Matrices.model; // MVP = p * V * M
-    glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-
-    draw3DObject(mirrors[i]);
+    if(isVisible(game.mirrorInfo[i].x, game.mirrorInfo[i].x2, game.mirrorInfo[i].y, game.mirrorInfo[i].y2))
+    {
+      visibleMirrors[visibleCount++] = mirrors[i];
+    }
   }
+  setModelTransform(0, 0);
+  draw3DObjects(visibleMirrors, visibleCount);
 
-  //Draw Cannon
-  Matrices.model = glm::mat4(1.0f);
-
-  glm::mat4 actualTranslateCannon = glm::translate (glm::vec3(-cannonInfo.y*sin(cannonInfo.angle*M_PI/180.0f),cannonInfo.y*cos(cannonInfo.angle*M_PI/180.0f), 0));
-
-  glm::mat4 translateCannon = glm::translate (glm::vec3(-screenLeftX, -cannonInfo.y, 0));        // glTranslatef
-  glm::mat4 rotateCannon = glm::rotate((float)(cannonInfo.angle*M_PI/180.0f), glm::vec3(0,0,1)); // rotate about vector (-1,1,1)
-  glm::mat4 translateCannon2 = glm::translate (glm::vec3(screenLeftX, cannonInfo.y, 0));
-
-  Matrices.model *= (actualTranslateCannon * translateCannon2 * rotateCannon * translateCannon);
-  MVP = VP * Matrices.model;
-  glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-
+  //Draw Cannon - rotate about its base, then raise it to its height
+  setModelTransform(0, scene->cannonY, scene->cannonAngle*M_PI/180.0f, screenLeftX, 0);
   draw3DObject(cannon);
 
   //Draw Death Ray
-  if(keyStates[GLFW_KEY_SPACE] && juiceEndX > juiceStartX)
+  if(scene->raySegmentCount > 0)
   {
-    juiceEndX = max(juiceEndX - 0.01f, juiceStartX);
-    rayAngle = cannonInfo.angle;
-    initRayX = rayPoints[0];
-    initRayY = rayPoints[1];
-    resetMirrors();
-
-    j = 0;
-    while(1)
-    {
-      flag = 0;
-      slopeRay = tan(rayAngle*M_PI/180.0f);
-      rayX2 = initRayX + 1000*cos(rayAngle*M_PI/180.0f);
-      rayY2 = initRayY + 1000*sin(rayAngle*M_PI/180.0f);
-      cRay = (initRayY*rayX2 - initRayX*rayY2)/(rayX2 - initRayX);
-
-      tempX = 100.0;
-      if(rayX2 - initRayX < 0)
-      {
-        tempX = -100.0;
-      }
-
-      // Check for intersections with any of the falling blocks
-      for(i = 0; i < 5000; i++)
-      {
-        if(slopeRay*(blockInfo[i].x) + cRay <= blockInfo[i].initY + blockInfo[i].y + 0.3
-        && blockInfo[i].initY + blockInfo[i].y <= slopeRay*(blockInfo[i].x) + cRay && blockInfo[i].y > -12
-        && ((rayX2 - initRayX)*(blockInfo[i].x - initRayX) > 0.0))
-        {
-          // First block to right (if ray moving towards right)
-          if(tempX > blockInfo[i].x && rayX2 - initRayX > 0)
-          {
-            tempX = blockInfo[i].x;
-            temp = i;
-          }
-
-          // First block to left (if ray moving towards left)
-          else if(tempX < blockInfo[i].x && rayX2 - initRayX < 0)
-          {
-            tempX = blockInfo[i].x;
-            temp = i;
-          }
-        }
-      }
-
-      // Finding out all the mirrors that the Death Ray might intersect with
-      for(i = 0; i < mirrorCount; i++)
-      {
-        slopeMirror = tan(mirrorInfo[i].angle*M_PI/180.0f);
-        x2 = mirrorInfo[i].x + mirrorInfo[i].length*cos(mirrorInfo[i].angle*M_PI/180.0f);
-        y2 = mirrorInfo[i].y + mirrorInfo[i].length*sin(mirrorInfo[i].angle*M_PI/180.0f);
-        cMirror = (mirrorInfo[i].y*x2 - mirrorInfo[i].x*y2)/(x2 - mirrorInfo[i].x);
-
-        // Find intercept if ray is not parallel to mirror
-        if(slopeRay != slopeMirror)
-        {
-          yIntercept = (slopeRay*cMirror - slopeMirror*cRay)/(slopeRay - slopeMirror);
-          xIntercept = (cMirror - cRay)/(slopeRay - slopeMirror);
-
-          if((mirrorInfo[i].x <= xIntercept) && (xIntercept <= x2) && (abs(mirrorInfo[i].intersectionX - xIntercept) > 0.0001)
-          && ((rayX2 - initRayX)*(xIntercept-initRayX) > 0.0))
-          {
-            potentialIntersections[i].x = xIntercept;
-            potentialIntersections[i].y = yIntercept;
-            flag++;
-          }
-        }
-      }
-
-      // Ray intersects with a block before intersecting with a mirror
-      if(abs(tempX) < 100 &&
-          (((tempX < potentialIntersections[getMin(potentialIntersections)].x) && (rayX2 - initRayX > 0.0))
-            || ((((potentialIntersections[getMax(potentialIntersections)].x != 100.0 && tempX > potentialIntersections[getMax(potentialIntersections)].x))
-            || (potentialIntersections[getMax(potentialIntersections)].x == 100.0)) && (rayX2 - initRayX < 0.0)))
-          )
-      {
-        createDeathRay(initRayX, initRayY, blockInfo[temp].x, blockInfo[i].initY + blockInfo[temp].y, j);
-
-        Matrices.model = glm::mat4(1.0f);
-        MVP = VP * Matrices.model;
-        glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-
-        draw3DObject(deathRay[j++]);
-
-        juiceEndX = juiceStartX;
-
-        blockInfo[temp].y = -100;
-        if(blockInfo[temp].type != 2)
-        {
-          score = max(score - 20, 0);
-          wrongHits++;
-        }
-        else
-        {
-          score += 10;
-        }
-        break;
-      }
-
-      // Death Ray does not intersect with any mirror
-      else if(flag == 0)
-      {
-        if(cos(rayAngle*M_PI/180.0f) > 0)
-        {
-          if(sin(rayAngle*M_PI/180.0f) > 0)
-          {
-            tempX = min((screenTopY - cRay)/slopeRay, screenRightX - 6.0f);
-            createDeathRay(initRayX, initRayY, tempX, slopeRay*tempX + cRay, j);
-          }
-          else if(sin(rayAngle*M_PI/180.0f) < 0)
-          {
-            tempX = min((screenBottomY - cRay)/slopeRay, screenRightX - 6.0f);
-            createDeathRay(initRayX, initRayY, tempX, slopeRay*tempX + cRay, j);
-          }
-
-          else
-          {
-            tempX = screenRightX - 6.0f;
-            createDeathRay(initRayX, initRayY, tempX, slopeRay*tempX + cRay, j);
-          }
-        }
-
-        else
-        {
-          if(sin(rayAngle*M_PI/180.0f) > 0)
-          {
-            tempX = max((screenTopY - cRay)/slopeRay, screenLeftX);
-            createDeathRay(initRayX, initRayY, tempX, slopeRay*tempX + cRay, j);
-          }
-          else if(sin(rayAngle*M_PI/180.0f) < 0)
-          {
-            tempX = max((screenBottomY - cRay)/slopeRay, screenLeftX);
-            createDeathRay(initRayX, initRayY, tempX, slopeRay*tempX + cRay, j);
-          }
-          else
-          {
-            tempX = -11.0;
-            createDeathRay(initRayX, initRayY, tempX, slopeRay*tempX + cRay, j);
-          }
-        }
-        // createDeathRay(initRayX, initRayY, initRayX + 1000*cos(rayAngle*M_PI/180.0f), initRayY + 1000*sin(rayAngle*M_PI/180.0f), j);
-
-        Matrices.model = glm::mat4(1.0f);
-        MVP = VP * Matrices.model;
-        glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-
-        draw3DObject(deathRay[j++]);
-        break;
-      }
-      /* Find the closest mirror that the Death Ray intersects with and draw a
-         line segment till the point of intersection */
-      else
-      {
-        temp = getMax(potentialIntersections);
-
-        // Ray is moving towards right
-        if(rayX2 - initRayX > 0.0)
-        {
-          temp = getMin(potentialIntersections);
-        }
-
-        createDeathRay(initRayX, initRayY, potentialIntersections[temp].x, potentialIntersections[temp].y, j);
-
-        Matrices.model = glm::mat4(1.0f);
-        MVP = VP * Matrices.model;
-        glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-
-        draw3DObject(deathRay[j++]);
-
-        initRayX = potentialIntersections[temp].x;
-        initRayY = potentialIntersections[temp].y;
-        rayAngle = 2*(mirrorInfo[temp].angle) - rayAngle;
-        mirrorInfo[temp].intersectionX = potentialIntersections[temp].x;
-      }
-      resetPotentialIntersections();
-    }
-  }
-}
-
-void updateScores()
-{
-  int i;
-  for(i = 0; i < 5000; i++)
-  {
-    if(blockInfo[i].y > -11.0 && blockInfo[i].y + screenTopY <= -4.7)
-    {
-      if((bucketInfo[0].topLeft <= bucketInfo[1].topLeft && bucketInfo[0].topRight >= bucketInfo[1].topLeft) ||
-        (bucketInfo[1].topLeft <= bucketInfo[0].topLeft && bucketInfo[1].topRight >= bucketInfo[0].topLeft)
-      )
-      {
-        // No change in score
-      }
-      else if(blockInfo[i].type == 0)
-      {
-        {
-          if(bucketInfo[0].topLeft <= blockInfo[i].x && blockInfo[i].x <= bucketInfo[0].topRight)
-          {
-            blockInfo[i].y = -100;
-            score += 5;
-          }
-          else if(bucketInfo[1].topLeft <= blockInfo[i].x && blockInfo[i].x <= bucketInfo[1].topRight)
-          {
-            blockInfo[i].y = -100;
-            score = max(score - 10, 0);
-          }
-        }
-      }
-      else if(blockInfo[i].type == 1)
-      {
-        if(bucketInfo[0].topLeft <= blockInfo[i].x && blockInfo[i].x <= bucketInfo[0].topRight)
-        {
-          blockInfo[i].y = -100;
-          score = max(score - 10, 0);
-        }
-        else if(bucketInfo[1].topLeft <= blockInfo[i].x && blockInfo[i].x <= bucketInfo[1].topRight)
-        {
-          blockInfo[i].y = -100;
-          score += 5;
-        }
-      }
-      else if(blockInfo[i].type == 2)
-      {
-        if(bucketInfo[0].topLeft <= blockInfo[i].x && blockInfo[i].x <= bucketInfo[0].topRight)
-        {
-          wrongCatch++;
-        }
-        else if(bucketInfo[1].topLeft <= blockInfo[i].x && blockInfo[i].x <= bucketInfo[1].topRight)
-        {
-          wrongCatch++;
-        }
-      }
-    }
+    setModelTransform(0, 0);
+    drawDeathRay();
   }
 }
 
@@ -1519,8 +1291,8 @@ GLFWwindow* initGLFW (int width, int height)
     /* Register function to handle mouse click */
     glfwSetMouseButtonCallback(window, mouseButton);  // mouse button clicks
     glfwSetScrollCallback(window, scroll_callback);
+    glfwSetCursorPosCallback(window, cursorPosition);  // mouse drags
 
-    windowCopy = window;
     return window;
 }
 
@@ -1535,11 +1307,32 @@ void initGL (GLFWwindow* window, int width, int height)
   createMirrors ();
   createScoreTile ();
   createCannon ();
+  createBattery ();
+  createDeathRay ();
+  uploadStaticGeometry ();
 
 	// Create and compile our GLSL program from the shaders
 	programID = LoadShaders( "Sample_GL.vert", "Sample_GL.frag" );
-	// Get a handle for our "MVP" uniform
-	Matrices.MatrixID = glGetUniformLocation(programID, "MVP");
+	// Get a handle for the model transform uniforms
+	Matrices.TransformID = glGetUniformLocation(programID, "transform");
+	Matrices.PivotID = glGetUniformLocation(programID, "pivot");
+
+	// Blocks are instanced and only need the camera
+	blockProgramID = LoadShaders( "Block_GL.vert", "Sample_GL.frag" );
+
+	// Score segments are instanced too, scaled to fit the digit count
+	segmentProgramID = LoadShaders( "Segment_GL.vert", "Sample_GL.frag" );
+	segmentScaleID = glGetUniformLocation(segmentProgramID, "scale");
+
+	// Camera is fixed for 2D (ortho) in XY plane - view-projection lives in one UBO shared by all programs
+	Matrices.view = glm::lookAt(glm::vec3(0,0,3), glm::vec3(0,0,0), glm::vec3(0,1,0));
+	glGenBuffers (1, &Matrices.CameraBuffer);
+	glBindBuffer (GL_UNIFORM_BUFFER, Matrices.CameraBuffer);
+	glBufferData (GL_UNIFORM_BUFFER, 16*sizeof(GLfloat), NULL, GL_DYNAMIC_DRAW);
+	glBindBufferBase (GL_UNIFORM_BUFFER, 0, Matrices.CameraBuffer);
+	glUniformBlockBinding (programID, glGetUniformBlockIndex(programID, "Camera"), 0);
+	glUniformBlockBinding (blockProgramID, glGetUniformBlockIndex(blockProgramID, "Camera"), 0);
+	glUniformBlockBinding (segmentProgramID, glGetUniformBlockIndex(segmentProgramID, "Camera"), 0);
 
 	reshapeWindow (window, width, height);
 
@@ -1554,45 +1347,235 @@ void initGL (GLFWwindow* window, int width, int height)
     cout << "RENDERER: " << glGetString(GL_RENDERER) << endl;
     cout << "VERSION: " << glGetString(GL_VERSION) << endl;
     cout << "GLSL: " << glGetString(GL_SHADING_LANGUAGE_VERSION) << endl;
+    cout << "SIMD: " << kernelName << endl;
 }
 
-int main (int argc, char** argv)
+/**************************
+ * Simulation thread - steps the game on its own clock and hands snapshots to the renderer
+ **************************/
+
+/* Copy the state the renderer draws into the back snapshot and make it the
+   newest. Called by the simulation thread */
+void publishSnapshot ()
 {
-  int width = 1100;
-  int height = 600;
+  Snapshot *next = &snapshots[snapshotBack];
+  const BlockStore &blocks = game.blocks;
 
-  mpg123_handle *mh;
-  unsigned char * buffer;
-  size_t buffer_size;
-  size_t done;
-  int i, bufferCount, err;
+  if(next->capacity < blocks.capacity)
+  {
+    next->capacity = blocks.capacity;
+    next->x = (float*) realloc(next->x, next->capacity*sizeof(float));
+    next->y = (float*) realloc(next->y, next->capacity*sizeof(float));
+    next->type = (int*) realloc(next->type, next->capacity*sizeof(int));
+  }
+  next->count = blocks.count;
+  memcpy(next->x, blocks.x, blocks.count*sizeof(float));
+  memcpy(next->y, blocks.y, blocks.count*sizeof(float));
+  memcpy(next->type, blocks.type, blocks.count*sizeof(int));
+
+  next->bucketOffset[0] = game.bucketInfo[0].topLeft - game.bucketInfo[0].initLeft;
+  next->bucketOffset[1] = game.bucketInfo[1].topLeft - game.bucketInfo[1].initLeft;
+  next->cannonY = game.cannonInfo.y;
+  next->cannonAngle = game.cannonInfo.angle;
+  next->juiceEndX = game.juiceEndX;
+  next->score = game.score;
+  next->wrongHits = game.wrongHits;
+  next->wrongCatch = game.wrongCatch;
+  next->raySegmentCount = game.raySegmentCount;
+  memcpy(next->rayVertexData, game.rayVertexData, 6*game.raySegmentCount*sizeof(GLfloat));
+
+  snapshotBack = snapshotMiddle.exchange(snapshotBack | SNAPSHOT_FRESH) & ~SNAPSHOT_FRESH;
+}
+
+/* Point scene at the newest snapshot, if one arrived since the last frame */
+void acquireSnapshot ()
+{
+  if(snapshotMiddle.load() & SNAPSHOT_FRESH)
+  {
+    snapshotFront = snapshotMiddle.exchange(snapshotFront) & ~SNAPSHOT_FRESH;
+    scene = &snapshots[snapshotFront];
+  }
+}
 
-  int defaultDriver;
-  ao_device *dev;
+/* Catch the game up with real time in fixed steps, publishing a snapshot
+   after each batch, then sleep until the next step is due */
+void simulationLoop ()
+{
+  double last = inputClock(), now, frame_time, accumulator = 0.0;
 
-  ao_sample_format format;
-  int channels, encoding;
-  long rate;
+  while(!simQuit)
+  {
+    now = inputClock();
+    frame_time = min(now - last, maxFrameTime);
+    last = now;
+    accumulator += frame_time;
 
-    GLFWwindow* window = initGLFW(width, height);
+    if(accumulator >= simTimeStep)
+    {
+      while (accumulator >= simTimeStep) {
+          // Input from up to the end of this step applies before it runs
+          drainInput(now - accumulator + simTimeStep);
+          update(&game);
+          accumulator -= simTimeStep;
+      }
+      publishSnapshot();
+    }
 
-  initialize();
+    this_thread::sleep_for(chrono::duration<double>(simTimeStep - accumulator));
+  }
+}
 
-	initGL (window, width, height);
+void startSimulation ()
+{
+  publishSnapshot();
+  acquireSnapshot();
+  simQuit = false;
+  simThread = thread(simulationLoop);
+}
 
-    double last_update_time = glfwGetTime(), current_time;
+void stopSimulation ()
+{
+  simQuit = true;
+  simThread.join();
+}
 
-  ao_initialize();
+/**************************
+ * Background music - decoded and played on threads of its own
+ **************************/
+
+/* Single producer, single consumer ring of PCM bytes from the decoder thread
+   to the playback thread. Each side only ever writes its own index, so the
+   two never take a lock. The indices count up forever and are masked on use */
+typedef struct AudioRing {
+  unsigned char data[AUDIO_RING_SIZE];
+  alignas(64) atomic<size_t> head;  // Bytes written - owned by the decoder
+  alignas(64) atomic<size_t> tail;  // Bytes read - owned by playback
+} AudioRing;
+
+AudioRing audioRing;
+mpg123_handle *mh;
+ao_device *dev;
+thread decoderThread, playbackThread;
+atomic<bool> audioQuit;
+atomic<bool> decoderStopped; // Set when the decoder gives up - playback drains the ring and stops too
+long audioUnderruns; // Times playback found the ring empty
+
+size_t audioRingWrite (const unsigned char *src, size_t n)
+{
+  size_t head = audioRing.head.load(memory_order_relaxed);
+  size_t start = head & (AUDIO_RING_SIZE - 1), first;
+
+  n = min(n, AUDIO_RING_SIZE - (head - audioRing.tail.load(memory_order_acquire)));
+  first = min(n, AUDIO_RING_SIZE - start);
+  memcpy(audioRing.data + start, src, first);
+  memcpy(audioRing.data, src + first, n - first);
+  audioRing.head.store(head + n, memory_order_release);
+  return n;
+}
+
+size_t audioRingRead (unsigned char *dst, size_t n)
+{
+  size_t tail = audioRing.tail.load(memory_order_relaxed);
+  size_t start = tail & (AUDIO_RING_SIZE - 1), first;
+
+  n = min(n, audioRing.head.load(memory_order_acquire) - tail);
+  first = min(n, AUDIO_RING_SIZE - start);
+  memcpy(dst, audioRing.data + start, first);
+  memcpy(dst + first, audioRing.data, n - first);
+  audioRing.tail.store(tail + n, memory_order_release);
+  return n;
+}
+
+/* Keep the ring topped up, looping the track when it ends. A read that gives
+   nothing - a broken stream, or a track with no audio in it - backs off a
+   little longer each time, and after AUDIO_MAX_FAILURES in a row the decoder
+   stops and the rest of the game plays silent */
+void decodeAudio ()
+{
+  unsigned char buffer[AUDIO_CHUNK];
+  size_t done, written;
+  int result, failures = 0;
+
+  while(!audioQuit)
+  {
+    if(AUDIO_RING_SIZE - (audioRing.head - audioRing.tail) < AUDIO_CHUNK)
+    {
+      this_thread::sleep_for(chrono::milliseconds(2));
+      continue;
+    }
+
+    done = 0;
+    result = mpg123_read(mh, buffer, AUDIO_CHUNK, &done);
+    if(result != MPG123_OK)
+    {
+      mpg123_seek(mh, 0, SEEK_SET);
+    }
+    if(done == 0)
+    {
+      if(++failures >= AUDIO_MAX_FAILURES)
+      {
+        printf("Music stopped - the track could not be read: %s\n", result == MPG123_DONE ? "it has no audio" : mpg123_strerror(mh));
+        decoderStopped = true;
+        return;
+      }
+      this_thread::sleep_for(chrono::milliseconds(failures));
+      continue;
+    }
+    failures = 0;
+
+    for(written = 0; written < done; )
+    {
+      written += audioRingWrite(buffer + written, done - written);
+    }
+  }
+}
+
+/* Feed the sound device from the ring - ao_play may block, but only this thread waits on it.
+   Playback only starts once the decoder has filled the ring for the first time, so
+   waiting for that is not counted as running dry */
+void playAudio ()
+{
+  unsigned char buffer[AUDIO_CHUNK];
+  size_t n;
+
+  while(!audioQuit && !decoderStopped && audioRing.head.load(memory_order_acquire) <= AUDIO_RING_SIZE - AUDIO_CHUNK)
+  {
+    this_thread::sleep_for(chrono::milliseconds(1));
+  }
+
+  while(!audioQuit)
+  {
+    n = audioRingRead(buffer, AUDIO_CHUNK);
+    if(n == 0)
+    {
+      if(decoderStopped)
+        return;
+      audioUnderruns++;
+      this_thread::sleep_for(chrono::milliseconds(1));
+      continue;
+    }
+    ao_play(dev, (char *)buffer, n);
+  }
+}
 
-  defaultDriver = ao_default_driver_id();
+/* Open the track and the sound device and start the audio threads.
+   Without the track or a sound device the game simply runs silent */
+void startAudio ()
+{
+  int err, channels, encoding;
+  long rate;
+  ao_sample_format format;
+
+  ao_initialize();
   mpg123_init();
   mh = mpg123_new(NULL, &err);
-  buffer_size = 4096;
-  buffer = (unsigned char*) malloc(buffer_size * sizeof(unsigned char));
 
   /* open the file and get the decoding format */
-  mpg123_open(mh, "bomberman.mp3");
-  mpg123_getformat(mh, &rate, &channels, &encoding);
+  if(!mh || mpg123_open(mh, "bomberman.mp3") != MPG123_OK || mpg123_getformat(mh, &rate, &channels, &encoding) != MPG123_OK)
+  {
+    printf("No music - bomberman.mp3 could not be opened: %s\n", mh ? mpg123_strerror(mh) : mpg123_plain_strerror(err));
+    return;
+  }
 
   /* set the output format and open the output device */
   format.bits = mpg123_encsize(encoding) * BITS;
@@ -1600,57 +1583,148 @@ int main (int argc, char** argv)
   format.channels = channels;
   format.byte_format = AO_FMT_NATIVE;
   format.matrix = 0;
-  dev = ao_open_live(defaultDriver, &format, NULL);
+  dev = ao_open_live(ao_default_driver_id(), &format, NULL);
 
-    /* Draw in loop */
-    while (!glfwWindowShouldClose(window) && wrongHits < 10 && wrongCatch != 1) {
+  audioQuit = false;
+  decoderStopped = false;
+  if(dev)
+  {
+    decoderThread = thread(decodeAudio);
+    playbackThread = thread(playAudio);
+  }
+}
 
-        if(juiceEndX <= screenLeftX + 1.0)
-        {
-          juiceEndX += 0.008;
-        }
+void stopAudio ()
+{
+  audioQuit = true;
+  if(decoderThread.joinable())
+    decoderThread.join();
+  if(playbackThread.joinable())
+    playbackThread.join();
+
+  /* clean up */
+  if(dev)
+    ao_close(dev);
+  if(mh)
+  {
+    mpg123_close(mh);
+    mpg123_delete(mh);
+  }
+  mpg123_exit();
+  ao_shutdown();
+}
 
-        // Update Scores
-        updateScores();
+int main (int argc, char** argv)
+{
+  int width = 1100;
+  int height = 600;
+  int i;
 
-        // OpenGL Draw commands
-        keyStateCheck();
-        reshapeWindow (window, width, height);
+  // --max-blocks N raises the pool limit, --spawn-interval S spawns a block every S seconds,
+  // --threads N sets the number of threads updating blocks, --scaling N times the block update over N blocks,
+  // --seed N replays the spawns and mirrors of an earlier game
+  int threads = max((int)thread::hardware_concurrency(), 1), scalingBlocks = 0;
+  game.seed = (uint64_t)time(0);
+  for(i = 1; i < argc; i++)
+  {
+    if(!strcmp(argv[i], "--max-blocks") && i + 1 < argc)
+    {
+      game.maxBlocks = max(atoi(argv[++i]), 1);
+    }
+    else if(!strcmp(argv[i], "--spawn-interval") && i + 1 < argc)
+    {
+      game.updateTime = max(atof(argv[++i]), 0.000001);
+    }
+    else if(!strcmp(argv[i], "--threads") && i + 1 < argc)
+    {
+      threads = max(atoi(argv[++i]), 1);
+    }
+    else if(!strcmp(argv[i], "--scaling") && i + 1 < argc)
+    {
+      scalingBlocks = max(atoi(argv[++i]), 1);
+    }
+    else if(!strcmp(argv[i], "--seed") && i + 1 < argc)
+    {
+      game.seed = strtoull(argv[++i], NULL, 10);
+    }
+  }
+  // Slots for timing the frame jobs, next to the core's own
+  statBlockInstances = registerJobStat("block instances");
+  statScore = registerJobStat("score digits");
+  startScheduler(threads);
 
-        /* Play sound */
-        if (mpg123_read(mh, buffer, buffer_size, &done) == MPG123_OK)
-        {
-          ao_play(dev, (char *)buffer, done);
-        }
-        else
-        {
-          mpg123_seek(mh, 0, SEEK_SET);
-        }
+  if(scalingBlocks > 0)
+  {
+    initGame(&game);
+    reportScaling(&game, scalingBlocks);
+    stopScheduler();
+    return 0;
+  }
+
+    GLFWwindow* window = initGLFW(width, height);
+
+  initGame(&game);
+
+	initGL (window, width, height);
+
+  startAudio();
+  startSimulation();
+
+    /* Draw in loop */
+    while (!glfwWindowShouldClose(window) && scene->wrongHits < maxWrongHits && scene->wrongCatch < maxWrongCatches) {
+
+        // Game input goes through the input queue - only the view is handled here
+        viewKeyCheck(window);
+
+        // OpenGL Draw commands - only ever from the latest published snapshot
+        acquireSnapshot();
+        reshapeWindow (window, width, height);
 
         // Swap Frame Buffer in double buffering
         glfwSwapBuffers(window);
 
         // Poll for Keyboard and mouse events
         glfwPollEvents();
-
-        // Control based on time (Time based transformation like 5 degrees rotation every 0.5s)
-        current_time = glfwGetTime(); // Time in seconds
-        if ((current_time - last_update_time) >= updateTime) { // atleast 1s elapsed since last frame
-            // do something every 0.5 seconds ..
-            insertBlock();
-            last_update_time = current_time;
-        }
     }
 
-    printf("\n\nGame Over!\n______________________\n\nYou Final Score is %d\n\n", score);
-    /* clean up */
-    free(buffer);
-    ao_close(dev);
-    mpg123_close(mh);
-    mpg123_delete(mh);
-    mpg123_exit();
-    ao_shutdown();
+    stopSimulation();
 
+    printf("\n\nGame Over!\n______________________\n\nYou Final Score is %d\n\n", game.score);
+    printf("Seed : %llu (play the same blocks and mirrors again with --seed)\n\n", (unsigned long long)game.seed);
+    if(framesDrawn > 0)
+    {
+      printf("Blocks per frame : %.1f submitted, %.1f culled\n\n", (double)totalBlocksSubmitted/framesDrawn, (double)totalBlocksCulled/framesDrawn);
+      printf("Redundant GL state calls skipped per frame : %.1f\n\n", (double)glState.SkippedCalls/framesDrawn);
+    }
+    if(game.blocks.exhausted > 0)
+    {
+      printf("Blocks not spawned because the pool of %d was full : %ld\n\n", game.maxBlocks, game.blocks.exhausted);
+    }
+    stopAudio();
+    if(frameGraphs > 0)
+    {
+      printf("Frame task graph : %.3f ms critical path, %.3f ms start to finish\n\n", 1000.0*frameCriticalPath/frameGraphs, 1000.0*frameGraphTime/frameGraphs);
+    }
+    JobTiming jobTimings[MAX_JOB_STATS];
+    mergeJobTimings(jobTimings);
+    printf("Job            runs    mean ms   longest ms\n");
+    for(i = 0; i < jobStatCount; i++)
+    {
+      if(jobTimings[i].runs > 0)
+      {
+        printf("%-15s %8ld %9.4f %9.4f\n", jobStatNames[i], jobTimings[i].runs, 1000.0*jobTimings[i].total/jobTimings[i].runs, 1000.0*jobTimings[i].longest);
+      }
+    }
+    printf("\n");
+    if(inputQueue.dropped > 0)
+    {
+      printf("Input events dropped because the queue was full : %ld\n\n", inputQueue.dropped);
+    }
+    if(audioUnderruns > 0)
+    {
+      printf("Times the music ran dry waiting on the decoder : %ld\n\n", audioUnderruns);
+    }
+    stopScheduler();
     glfwTerminate();
 //    exit(EXIT_SUCCESS);
 }
@@ -0,0 +1,1488 @@
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#include <assert.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#include "brickcore.h"
+
+using namespace std;
+
+// Block speed is the distance moved per step at the original rate of two draws per 60 Hz frame
+static const float blockStepRate = 120.0f;
+// Battery charge and discharge in units of width per second
+static const float juiceRechargeRate = 0.48f;
+static const float juiceDrainRate = 1.2f;
+// Tolerance for parallel mirrors and the death ray hitting its own origin
+static const float rayEpsilon = 0.0001f;
+// Held keys move things this many times a second, as they did once per 60 Hz frame
+static const float heldInputRate = 60.0f;
+
+void checkAndSelect(GameState *game);
+void moveSelected(GameState *game);
+void resetMouseCoordinates(GameState *game);
+void resetSelectState(GameState *game);
+void selectKernels();
+uint32_t nextRandom(Random *rng);
+once_flag kernelsSelected;
+bool growBlockPool(GameState *game);
+long predictArrival(GameState *game, float y);
+void rekeyArrivals(GameState *game);
+void setSpeed(GameState *game, float speed);
+
+/* Seconds on the clock shared by input timestamps and the simulation */
+double inputClock ()
+{
+  return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void seedRandom (Random *rng, uint64_t seed, RandomStream stream)
+{
+  rng->state = 0;
+  rng->inc = ((uint64_t)stream << 1) | 1;
+  nextRandom(rng);
+  rng->state += seed;
+  nextRandom(rng);
+}
+
+uint32_t nextRandom (Random *rng)
+{
+  uint64_t old = rng->state;
+  uint32_t xorshifted = ((old >> 18) ^ old) >> 27, rot = old >> 59;
+
+  rng->state = old*6364136223846793005ULL + rng->inc;
+  return (xorshifted >> rot) | (xorshifted << ((-rot) & 31));
+}
+
+/* Uniform in [low, high) */
+float randomFloat (Random *rng, float low, float high)
+{
+  return low + (high - low)*(nextRandom(rng) >> 8)*(1.0f/16777216.0f);
+}
+
+/* Uniform in [0, n) */
+int randomInt (Random *rng, int n)
+{
+  return (int)(((uint64_t)nextRandom(rng)*n) >> 32);
+}
+
+/* Lay the mirrors out at random */
+void placeMirrors (GameState *game)
+{
+  int i;
+  Mirror *mirrorInfo = game->mirrorInfo;
+
+  game->mirrorCount = randomInt(&game->mirrorLayout, 3) + 3;
+
+  for(i = 0; i < game->mirrorCount; i++)
+  {
+    mirrorInfo[i].x = randomFloat(&game->mirrorLayout, -6.94, 2.0);
+    mirrorInfo[i].y = randomFloat(&game->mirrorLayout, -2.94, 3.0);
+    mirrorInfo[i].angle = randomFloat(&game->mirrorLayout, 1.0, 89.0);
+    mirrorInfo[i].length = min(4.0, (screenRightX - 6.0 - mirrorInfo[i].x)/cos(mirrorInfo[i].angle*M_PI/180.0f));
+
+    // Mirrors never move, so the far end and normal are worked out once here for the ray tracer
+    mirrorInfo[i].x2 = mirrorInfo[i].x + mirrorInfo[i].length*cos(mirrorInfo[i].angle*M_PI/180.0f);
+    mirrorInfo[i].y2 = mirrorInfo[i].y + mirrorInfo[i].length*sin(mirrorInfo[i].angle*M_PI/180.0f);
+    mirrorInfo[i].nx = -sin(mirrorInfo[i].angle*M_PI/180.0f);
+    mirrorInfo[i].ny = cos(mirrorInfo[i].angle*M_PI/180.0f);
+  }
+}
+
+/* Put the red bucket and then the green one at their starting places */
+void placeBuckets (GameState *game)
+{
+  int i;
+  float initLoc = -4.5;
+
+  for(i = 0; i < 2; i++)
+  {
+    game->bucketInfo[i].topLeft = initLoc - 0.8;
+    game->bucketInfo[i].topRight = initLoc + 0.8;
+    game->bucketInfo[i].bottomLeft = initLoc - 0.3;
+    game->bucketInfo[i].bottomRight = initLoc + 0.3;
+    game->bucketInfo[i].initLeft = game->bucketInfo[i].topLeft;
+
+    initLoc = -1.5;
+  }
+}
+
+void initGame (GameState *game)
+{
+  int i;
+
+  game->score = 0;
+  game->wrongHits = 0;
+  game->wrongCatch = 0;
+  game->spawnTime = 0;
+  game->juiceEndX = juiceStartX;
+  game->raySegmentCount = 0;
+  game->fallStep = game->speed*blockStepRate*(float)simTimeStep;
+  seedRandom(&game->spawnX, game->seed, STREAM_SPAWN_X);
+  seedRandom(&game->spawnType, game->seed, STREAM_BLOCK_TYPE);
+  seedRandom(&game->mirrorLayout, game->seed, STREAM_MIRRORS);
+  call_once(kernelsSelected, selectKernels);
+
+  // No blocks are live to begin with - every slot is free, lowest handed out first
+  memset(&game->blocks, 0, sizeof(game->blocks));
+  game->nextInColumn = game->prevInColumn = NULL;
+  game->arrivalTick = NULL;
+  game->arrivalHeap = game->arrivalPos = NULL;
+  game->catchHits = game->fallenBlocks = game->dueSlots = NULL;
+  game->dueX = game->dueY = NULL;
+  game->chunks.jobs = NULL;
+  game->chunks.capacity = 0;
+  game->simTick = 0;
+  game->arrivalCount = 0;
+  growBlockPool(game);
+  for (i = 0; i < BLOCK_COLUMNS; i++)
+  {
+    game->columnHead[i] = -1;
+  }
+
+  // Initializing the pressed state of all keys and mouse buttons to false
+  for(i = 0; i < GAME_KEY_COUNT; i++)
+  {
+    game->keyStates[i] = false;
+  }
+  for(i = 0; i < GAME_BUTTON_COUNT; i++)
+  {
+    game->mouseStates[i] = false;
+  }
+  game->cursorX = game->cursorY = 0;
+
+  placeBuckets(game);
+  placeMirrors(game);
+
+  game->cannonInfo.y = 0;
+  game->cannonInfo.angle = 0;
+
+  game->rayPoints[0] = screenLeftX;
+  game->rayPoints[1] = 0.0;
+
+  resetMouseCoordinates(game);
+  resetSelectState(game);
+}
+
+void freeGame (GameState *game)
+{
+  free(game->blocks.x);
+  free(game->blocks.y);
+  free(game->blocks.type);
+  free(game->blocks.slot);
+  free(game->blocks.position);
+  free(game->blocks.freeSlots);
+  free(game->nextInColumn);
+  free(game->prevInColumn);
+  free(game->arrivalTick);
+  free(game->arrivalHeap);
+  free(game->arrivalPos);
+  free(game->catchHits);
+  free(game->fallenBlocks);
+  free(game->dueSlots);
+  free(game->dueX);
+  free(game->dueY);
+  delete[] game->chunks.jobs;
+  memset(&game->blocks, 0, sizeof(game->blocks));
+  game->chunks.jobs = NULL;
+  game->chunks.capacity = 0;
+}
+
+/* Change the game for one input event */
+void applyInput (GameState *game, const InputEvent *event)
+{
+  switch (event->type) {
+    case INPUT_KEY:
+      game->keyStates[event->code] = event->pressed;
+      if (!event->pressed)
+        break;
+      switch (event->code) {
+          case GAME_KEY_I:
+              game->updateTime = max(game->updateTime - 0.25, 0.25);
+              break;
+          case GAME_KEY_O:
+              game->updateTime = min(game->updateTime + 0.25, 1.75);
+              break;
+          case GAME_KEY_N:
+              setSpeed(game, min(game->speed + 0.01, 0.1));
+              break;
+          case GAME_KEY_M:
+              setSpeed(game, max(game->speed - 0.001, 0.001));
+              break;
+          default:
+              break;
+      }
+      break;
+
+    case INPUT_MOUSE_BUTTON:
+      game->mouseStates[event->code] = event->pressed;
+      game->cursorX = event->x;
+      game->cursorY = event->y;
+      if (!event->pressed) {
+          resetMouseCoordinates(game);
+          resetSelectState(game);
+      }
+      break;
+
+    case INPUT_CURSOR:
+      game->cursorX = event->x;
+      game->cursorY = event->y;
+      break;
+  }
+}
+
+/* Move the buckets and cannon for the keys and mouse buttons held through a step of dt seconds */
+void heldInputCheck (GameState *game, float dt)
+{
+  float step = 0.1f*heldInputRate*dt;
+  bool *keyStates = game->keyStates;
+  Bucket *bucketInfo = game->bucketInfo;
+  Cannon &cannonInfo = game->cannonInfo;
+
+  // Bucket Controls
+  if (keyStates[GAME_KEY_LEFT])
+  {
+    if(keyStates[GAME_KEY_LEFT_ALT] || keyStates[GAME_KEY_RIGHT_ALT])
+    {
+      bucketInfo[0].topLeft = max(bucketInfo[0].topLeft-step, screenLeftX+1.0f);
+      bucketInfo[0].topRight = bucketInfo[0].topLeft + 1.6;
+    }
+    else if(keyStates[GAME_KEY_LEFT_CONTROL] || keyStates[GAME_KEY_RIGHT_CONTROL])
+    {
+      bucketInfo[1].topLeft = max(bucketInfo[1].topLeft-step, screenLeftX+1.0f);
+      bucketInfo[1].topRight = bucketInfo[1].topLeft + 1.6;
+    }
+  }
+  if (keyStates[GAME_KEY_RIGHT])
+  {
+    if(keyStates[GAME_KEY_LEFT_ALT] || keyStates[GAME_KEY_RIGHT_ALT])
+    {
+      bucketInfo[0].topRight = min(bucketInfo[0].topRight+step, screenRightX-7.0f);
+      bucketInfo[0].topLeft = bucketInfo[0].topRight - 1.6;
+    }
+    else if(keyStates[GAME_KEY_LEFT_CONTROL] || keyStates[GAME_KEY_RIGHT_CONTROL])
+    {
+      bucketInfo[1].topRight = min(bucketInfo[1].topRight+step, screenRightX-7.0f);
+      bucketInfo[1].topLeft = bucketInfo[1].topRight - 1.6;
+    }
+  }
+
+  // Cannon Controls
+  if(keyStates[GAME_KEY_A])
+  {
+    cannonInfo.angle = min(cannonInfo.angle+step, 45.0f);
+  }
+
+  if(keyStates[GAME_KEY_D])
+  {
+    cannonInfo.angle = max(cannonInfo.angle-step, -45.0f);
+  }
+  if(keyStates[GAME_KEY_S])
+  {
+    cannonInfo.y = min(cannonInfo.y+step, 3.5f);
+    game->rayPoints[1] = cannonInfo.y;
+  }
+  if(keyStates[GAME_KEY_F])
+  {
+    cannonInfo.y = max(cannonInfo.y-step, -3.5f);
+    game->rayPoints[1] = cannonInfo.y;
+  }
+
+  // Mouse Controls
+  if(game->mouseStates[GAME_BUTTON_LEFT])
+  {
+    game->mouseX = game->cursorX;
+    game->mouseY = game->cursorY;
+    // Mouse selection
+    checkAndSelect(game);
+    moveSelected(game);
+  }
+}
+
+void checkAndSelect(GameState *game)
+{
+  int i, flag = 0;
+  double mouseX = game->mouseX, mouseY = game->mouseY;
+  Bucket *bucketInfo = game->bucketInfo;
+  Cannon &cannonInfo = game->cannonInfo;
+
+  if(game->selected)
+    return;
+
+  // Check if Bucket is selected
+  for(i = 0; i < 2; i++)
+  {
+    if(mouseY <= screenBottomY + 1.0 && screenBottomY <= mouseY)
+    {
+      float C1 = screenBottomY - mouseY + (mouseX - bucketInfo[i].bottomLeft)/(bucketInfo[i].topLeft - bucketInfo[i].bottomLeft);
+      float C2 = (bucketInfo[i].bottomRight - bucketInfo[i].bottomLeft)/(bucketInfo[i].topLeft - bucketInfo[i].bottomLeft);
+
+      float C3 = screenBottomY - mouseY + (mouseX - bucketInfo[i].bottomRight)/(bucketInfo[i].topRight - bucketInfo[i].bottomRight);
+      float C4 = (bucketInfo[i].bottomLeft - bucketInfo[i].bottomRight)/(bucketInfo[i].topRight - bucketInfo[i].bottomRight);
+
+      if(C1*C2 >= 0 && C3*C4 >= 0)
+      {
+        bucketInfo[i].selected = true;
+        game->selected = true;
+        flag++;
+        break;
+      }
+    }
+  }
+
+  // Check if Cannon is selected
+  if(flag == 0)
+  {
+    float Y2 = cannonInfo.y + cannonInfo.length*sin(cannonInfo.angle*M_PI/180.0);
+
+    if(mouseY <= max(cannonInfo.y, Y2) && min(cannonInfo.y, Y2) <= mouseY)
+    {
+      if(mouseX <= screenLeftX + cannonInfo.length*cos(cannonInfo.angle*M_PI/180.0))
+      {
+        cannonInfo.selected = true;
+        game->selected = true;
+      }
+    }
+  }
+}
+
+void resetMouseCoordinates(GameState *game)
+{
+  game->mouseX = 100.0;
+  game->mouseY = 100.0;
+}
+
+void resetSelectState(GameState *game)
+{
+  int i;
+
+  game->selected = false;
+
+  game->cannonInfo.selected = false;
+
+  for(i = 0; i < 2; i++)
+  {
+    game->bucketInfo[i].selected = false;
+  }
+}
+
+void moveSelected(GameState *game)
+{
+  int i;
+  float temp;
+  double mouseX = game->mouseX, mouseY = game->mouseY;
+  Bucket *bucketInfo = game->bucketInfo;
+  Cannon &cannonInfo = game->cannonInfo;
+
+  // Move selected bucket
+  for(i = 0; i < 2; i++)
+  {
+    if(bucketInfo[i].selected)
+    {
+      bucketInfo[i].topLeft = max(mouseX, screenLeftX + 1.0);
+      if(bucketInfo[i].topLeft > 0)
+      {
+        bucketInfo[i].topLeft = min(mouseX, screenRightX - 8.6);
+      }
+      bucketInfo[i].topRight = bucketInfo[i].topLeft + 1.6;
+      return;
+    }
+  }
+
+  // Move selected Cannon
+  if(cannonInfo.selected)
+  {
+    cannonInfo.y = max(mouseY, -3.5);
+    cannonInfo.y = min(mouseY, 3.5);
+    game->rayPoints[1] = cannonInfo.y;
+    return;
+  }
+
+  temp = atan2((mouseY - cannonInfo.y) , (mouseX - screenLeftX))*180.0f/M_PI;
+  cannonInfo.angle = min(temp, 45.0f);
+  if(cannonInfo.angle < 0)
+  {
+    cannonInfo.angle = max(temp, -45.0f);
+  }
+}
+
+// Adds one segment to the current death ray path
+void addDeathRaySegment (GameState *game, float startPointX, float startPointY, float endPointX, float endPointY)
+{
+  float *segment = &game->rayVertexData[6*game->raySegmentCount++];
+
+  segment[0] = endPointX;
+  segment[1] = endPointY;
+  segment[2] = 0;
+  segment[3] = startPointX;
+  segment[4] = startPointY;
+  segment[5] = 0;
+}
+
+int blockColumn (float x)
+{
+  int c = (int)floor((x - screenLeftX)*BLOCK_COLUMNS/(screenRightX - 6.0f - screenLeftX));
+  return min(max(c, 0), BLOCK_COLUMNS - 1);
+}
+
+void addToColumn (GameState *game, int slot, float x)
+{
+  int c = blockColumn(x);
+
+  game->prevInColumn[slot] = -1;
+  game->nextInColumn[slot] = game->columnHead[c];
+  if(game->columnHead[c] != -1)
+  {
+    game->prevInColumn[game->columnHead[c]] = slot;
+  }
+  game->columnHead[c] = slot;
+}
+
+void removeFromColumn (GameState *game, int slot, float x)
+{
+  int *nextInColumn = game->nextInColumn, *prevInColumn = game->prevInColumn;
+
+  if(prevInColumn[slot] != -1)
+  {
+    nextInColumn[prevInColumn[slot]] = nextInColumn[slot];
+  }
+  else
+  {
+    game->columnHead[blockColumn(x)] = nextInColumn[slot];
+  }
+  if(nextInColumn[slot] != -1)
+  {
+    prevInColumn[nextInColumn[slot]] = prevInColumn[slot];
+  }
+}
+
+/* Walk the columns crossed by the ray (ox, oy) + t*(dx, dy), 0 < t < tMax,
+   nearest first, and return the position of the first block it passes
+   through, or -1 on a miss. The distance along the ray goes in *tHit */
+int firstBlockOnRay (const GameState *game, float ox, float oy, float dx, float dy, float tMax, float *tHit)
+{
+  int c, last, step, slot, k, hit = -1;
+  float t, y, best = tMax;
+  const BlockStore &blocks = game->blocks;
+
+  // A vertical ray runs between block centres, as it always has
+  if(fabs(dx) < rayEpsilon)
+    return -1;
+
+  step = (dx > 0.0) ? 1 : -1;
+  last = blockColumn(ox + tMax*dx);
+  for(c = blockColumn(ox); ; c += step)
+  {
+    for(slot = game->columnHead[c]; slot != -1; slot = game->nextInColumn[slot])
+    {
+      k = blocks.position[slot];
+      t = (blocks.x[k] - ox)/dx;
+      y = oy + t*dy;
+      if(t > 0.0 && t < best && blockInitY + blocks.y[k] <= y && y <= blockInitY + blocks.y[k] + 0.3)
+      {
+        best = t;
+        hit = k;
+      }
+    }
+
+    // Columns are visited in order along the ray, so the first hit is the nearest
+    if(hit != -1 || c == last)
+      break;
+  }
+  *tHit = best;
+  return hit;
+}
+
+void swapArrivals (GameState *game, int i, int j)
+{
+  int *arrivalHeap = game->arrivalHeap;
+  int slot = arrivalHeap[i];
+
+  arrivalHeap[i] = arrivalHeap[j];
+  arrivalHeap[j] = slot;
+  game->arrivalPos[arrivalHeap[i]] = i;
+  game->arrivalPos[arrivalHeap[j]] = j;
+}
+
+void siftArrivalUp (GameState *game, int i)
+{
+  const long *arrivalTick = game->arrivalTick;
+  const int *arrivalHeap = game->arrivalHeap;
+
+  while(i > 0 && arrivalTick[arrivalHeap[i]] < arrivalTick[arrivalHeap[(i - 1)/2]])
+  {
+    swapArrivals(game, i, (i - 1)/2);
+    i = (i - 1)/2;
+  }
+}
+
+void siftArrivalDown (GameState *game, int i)
+{
+  int c;
+  const long *arrivalTick = game->arrivalTick;
+  const int *arrivalHeap = game->arrivalHeap;
+
+  while((c = 2*i + 1) < game->arrivalCount)
+  {
+    if(c + 1 < game->arrivalCount && arrivalTick[arrivalHeap[c + 1]] < arrivalTick[arrivalHeap[c]])
+      c++;
+    if(arrivalTick[arrivalHeap[i]] <= arrivalTick[arrivalHeap[c]])
+      break;
+    swapArrivals(game, i, c);
+    i = c;
+  }
+}
+
+void scheduleArrival (GameState *game, int slot, long tick)
+{
+  game->arrivalTick[slot] = tick;
+  game->arrivalHeap[game->arrivalCount] = slot;
+  game->arrivalPos[slot] = game->arrivalCount++;
+  siftArrivalUp(game, game->arrivalPos[slot]);
+}
+
+void cancelArrival (GameState *game, int slot)
+{
+  int i = game->arrivalPos[slot];
+
+  if(i < 0)
+    return;
+
+  game->arrivalPos[slot] = -1;
+  if(i != --game->arrivalCount)
+  {
+    game->arrivalHeap[i] = game->arrivalHeap[game->arrivalCount];
+    game->arrivalPos[game->arrivalHeap[i]] = i;
+    siftArrivalDown(game, i);
+    siftArrivalUp(game, i);
+  }
+}
+
+/* Resize a per-block array to n entries, keeping its contents. On failure the
+   old array is left in place and false is returned */
+template <typename T> bool resizeBlockArray (T *&array, int n)
+{
+  T *grown = (T*) realloc(array, n*sizeof(T));
+
+  if(!grown)
+    return false;
+  array = grown;
+  return true;
+}
+
+/* Grow every per-block array by another chunk of slots and put the new slots
+   on the free stack, lowest on top. Returns false once maxBlocks is reached
+   or memory runs out */
+bool growBlockPool (GameState *game)
+{
+  BlockStore &blocks = game->blocks;
+  int i, n = min(blocks.capacity + BLOCK_CHUNK, game->maxBlocks);
+
+  if(n <= blocks.capacity)
+    return false;
+
+  if(!(resizeBlockArray(blocks.x, n) && resizeBlockArray(blocks.y, n) && resizeBlockArray(blocks.type, n)
+    && resizeBlockArray(blocks.slot, n) && resizeBlockArray(blocks.position, n) && resizeBlockArray(blocks.freeSlots, n)
+    && resizeBlockArray(game->nextInColumn, n) && resizeBlockArray(game->prevInColumn, n)
+    && resizeBlockArray(game->arrivalTick, n) && resizeBlockArray(game->arrivalHeap, n) && resizeBlockArray(game->arrivalPos, n)
+    && resizeBlockArray(game->catchHits, n) && resizeBlockArray(game->fallenBlocks, n)
+    && resizeBlockArray(game->dueSlots, n) && resizeBlockArray(game->dueX, n) && resizeBlockArray(game->dueY, n)))
+  {
+    // Out of memory - arrays that did grow are merely oversized, so stop here
+    game->maxBlocks = blocks.capacity;
+    return false;
+  }
+
+  for(i = n - 1; i >= blocks.capacity; i--)
+  {
+    blocks.position[i] = -1;
+    game->arrivalPos[i] = -1;
+    blocks.freeSlots[blocks.freeCount++] = i;
+  }
+  blocks.capacity = n;
+  return true;
+}
+
+/* Take a free slot and pack a new block for it at the end of the store.
+   Returns the block's position, or -1 when the pool is exhausted */
+int acquireBlock(GameState *game)
+{
+  BlockStore &blocks = game->blocks;
+  int i, k;
+
+  if(blocks.freeCount == 0 && !growBlockPool(game))
+  {
+    blocks.exhausted++;
+    return -1;
+  }
+
+  i = blocks.freeSlots[--blocks.freeCount];
+  k = blocks.count++;
+  blocks.slot[k] = i;
+  blocks.position[i] = k;
+  return k;
+}
+
+/* Release the block packed at position k - the last live block takes its place */
+void releaseBlock(GameState *game, int k)
+{
+  BlockStore &blocks = game->blocks;
+  int last = --blocks.count;
+
+  removeFromColumn(game, blocks.slot[k], blocks.x[k]);
+  cancelArrival(game, blocks.slot[k]);
+  blocks.position[blocks.slot[k]] = -1;
+  blocks.freeSlots[blocks.freeCount++] = blocks.slot[k];
+  if(k != last)
+  {
+    blocks.x[k] = blocks.x[last];
+    blocks.y[k] = blocks.y[last];
+    blocks.type[k] = blocks.type[last];
+    blocks.slot[k] = blocks.slot[last];
+    blocks.position[blocks.slot[k]] = k;
+  }
+}
+
+void insertBlock(GameState *game)
+{
+  BlockStore &blocks = game->blocks;
+  int k = acquireBlock(game);
+
+  if(k < 0)
+    return;
+
+  blocks.x[k] = randomFloat(&game->spawnX, blockSpawnLeftX, blockSpawnRightX);
+  blocks.y[k] = 0;
+  blocks.type[k] = randomInt(&game->spawnType, 3);
+  addToColumn(game, blocks.slot[k], blocks.x[k]);
+  scheduleArrival(game, blocks.slot[k], predictArrival(game, blocks.y[k]));
+}
+
+/**************************
+ * Block kernels - the per-block work of a step, in scalar, SSE and AVX2 forms
+ **************************/
+
+// Catch zone just above the buckets, as distance fallen
+static const float catchZoneTop = -4.7f - screenTopY;
+static const float catchZoneBottom = -11.0f;
+
+// What happens when a block of each type lands in bucket 0 (red) or bucket 1 (green)
+typedef struct CatchRule {
+  int score;
+  bool remove;
+  bool wrong;
+} CatchRule;
+
+static const CatchRule catchRules[3][2] = {
+  {{5, true, false}, {-10, true, false}},   // Red block
+  {{-10, true, false}, {5, true, false}},   // Green block
+  {{0, false, true}, {0, false, true}}      // Blue block - must be shot, never caught
+};
+
+/* Move blocks down by step and list the positions of those that fell off
+   the bottom, in increasing order. Returns how many fell */
+typedef int (*FallKernel)(float *y, int count, float step, int *fallen);
+
+/* List the blocks in the catch zone that are over a bucket, in increasing order,
+   as position*2 + bucket. limits holds bucket 0 left, right, then bucket 1 left, right */
+typedef int (*CatchKernel)(const float *x, const float *y, int count, const float *limits, int *hits);
+
+FallKernel fallBlocks;
+CatchKernel catchBlocks;
+const char *kernelName;
+
+// Scalar loops - also finish off the tails the vector kernels leave
+int fallBlocksFrom (int start, float *y, int count, float step, int *fallen)
+{
+  int i, n = 0;
+
+  for(i = start; i < count; i++)
+  {
+    y[i] -= step;
+    if(y[i] < -12.0f)
+      fallen[n++] = i;
+  }
+  return n;
+}
+
+int catchBlocksFrom (int start, const float *x, const float *y, int count, const float *limits, int *hits)
+{
+  int i, n = 0;
+
+  for(i = start; i < count; i++)
+  {
+    if(y[i] > catchZoneBottom && y[i] <= catchZoneTop)
+    {
+      if(limits[0] <= x[i] && x[i] <= limits[1])
+        hits[n++] = 2*i;
+      else if(limits[2] <= x[i] && x[i] <= limits[3])
+        hits[n++] = 2*i + 1;
+    }
+  }
+  return n;
+}
+
+int fallBlocksScalar (float *y, int count, float step, int *fallen)
+{
+  return fallBlocksFrom(0, y, count, step, fallen);
+}
+
+int catchBlocksScalar (const float *x, const float *y, int count, const float *limits, int *hits)
+{
+  return catchBlocksFrom(0, x, y, count, limits, hits);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("sse2")))
+int fallBlocksSSE (float *y, int count, float step, int *fallen)
+{
+  int i, n = 0, mask;
+  __m128 s = _mm_set1_ps(step), bottom = _mm_set1_ps(-12.0f);
+
+  for(i = 0; i + 4 <= count; i += 4)
+  {
+    __m128 v = _mm_sub_ps(_mm_loadu_ps(y + i), s);
+    _mm_storeu_ps(y + i, v);
+    for(mask = _mm_movemask_ps(_mm_cmplt_ps(v, bottom)); mask; mask &= mask - 1)
+      fallen[n++] = i + __builtin_ctz(mask);
+  }
+  return n + fallBlocksFrom(i, y, count, step, fallen + n);
+}
+
+__attribute__((target("sse2")))
+int catchBlocksSSE (const float *x, const float *y, int count, const float *limits, int *hits)
+{
+  int i, n = 0, mask, mask1;
+  __m128 top = _mm_set1_ps(catchZoneTop), bottom = _mm_set1_ps(catchZoneBottom);
+  __m128 left0 = _mm_set1_ps(limits[0]), right0 = _mm_set1_ps(limits[1]);
+  __m128 left1 = _mm_set1_ps(limits[2]), right1 = _mm_set1_ps(limits[3]);
+
+  for(i = 0; i + 4 <= count; i += 4)
+  {
+    __m128 vy = _mm_loadu_ps(y + i);
+    __m128 zone = _mm_and_ps(_mm_cmpgt_ps(vy, bottom), _mm_cmple_ps(vy, top));
+    if(_mm_movemask_ps(zone) == 0)
+      continue;
+
+    __m128 vx = _mm_loadu_ps(x + i);
+    __m128 in0 = _mm_and_ps(zone, _mm_and_ps(_mm_cmple_ps(left0, vx), _mm_cmple_ps(vx, right0)));
+    __m128 in1 = _mm_and_ps(zone, _mm_and_ps(_mm_cmple_ps(left1, vx), _mm_cmple_ps(vx, right1)));
+    mask1 = _mm_movemask_ps(_mm_andnot_ps(in0, in1)); // Bucket 0 wins when both match
+    for(mask = _mm_movemask_ps(in0) | mask1; mask; mask &= mask - 1)
+    {
+      int lane = __builtin_ctz(mask);
+      hits[n++] = 2*(i + lane) + ((mask1 >> lane) & 1);
+    }
+  }
+  return n + catchBlocksFrom(i, x, y, count, limits, hits + n);
+}
+
+__attribute__((target("avx2")))
+int fallBlocksAVX2 (float *y, int count, float step, int *fallen)
+{
+  int i, n = 0, mask;
+  __m256 s = _mm256_set1_ps(step), bottom = _mm256_set1_ps(-12.0f);
+
+  for(i = 0; i + 8 <= count; i += 8)
+  {
+    __m256 v = _mm256_sub_ps(_mm256_loadu_ps(y + i), s);
+    _mm256_storeu_ps(y + i, v);
+    for(mask = _mm256_movemask_ps(_mm256_cmp_ps(v, bottom, _CMP_LT_OQ)); mask; mask &= mask - 1)
+      fallen[n++] = i + __builtin_ctz(mask);
+  }
+  return n + fallBlocksFrom(i, y, count, step, fallen + n);
+}
+
+__attribute__((target("avx2")))
+int catchBlocksAVX2 (const float *x, const float *y, int count, const float *limits, int *hits)
+{
+  int i, n = 0, mask, mask1;
+  __m256 top = _mm256_set1_ps(catchZoneTop), bottom = _mm256_set1_ps(catchZoneBottom);
+  __m256 left0 = _mm256_set1_ps(limits[0]), right0 = _mm256_set1_ps(limits[1]);
+  __m256 left1 = _mm256_set1_ps(limits[2]), right1 = _mm256_set1_ps(limits[3]);
+
+  for(i = 0; i + 8 <= count; i += 8)
+  {
+    __m256 vy = _mm256_loadu_ps(y + i);
+    __m256 zone = _mm256_and_ps(_mm256_cmp_ps(vy, bottom, _CMP_GT_OQ), _mm256_cmp_ps(vy, top, _CMP_LE_OQ));
+    if(_mm256_movemask_ps(zone) == 0)
+      continue;
+
+    __m256 vx = _mm256_loadu_ps(x + i);
+    __m256 in0 = _mm256_and_ps(zone, _mm256_and_ps(_mm256_cmp_ps(left0, vx, _CMP_LE_OQ), _mm256_cmp_ps(vx, right0, _CMP_LE_OQ)));
+    __m256 in1 = _mm256_and_ps(zone, _mm256_and_ps(_mm256_cmp_ps(left1, vx, _CMP_LE_OQ), _mm256_cmp_ps(vx, right1, _CMP_LE_OQ)));
+    mask1 = _mm256_movemask_ps(_mm256_andnot_ps(in0, in1)); // Bucket 0 wins when both match
+    for(mask = _mm256_movemask_ps(in0) | mask1; mask; mask &= mask - 1)
+    {
+      int lane = __builtin_ctz(mask);
+      hits[n++] = 2*(i + lane) + ((mask1 >> lane) & 1);
+    }
+  }
+  return n + catchBlocksFrom(i, x, y, count, limits, hits + n);
+}
+#endif
+
+/* Pick the widest kernels this CPU can run */
+void selectKernels ()
+{
+  fallBlocks = fallBlocksScalar;
+  catchBlocks = catchBlocksScalar;
+  kernelName = "scalar";
+
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("avx2"))
+  {
+    fallBlocks = fallBlocksAVX2;
+    catchBlocks = catchBlocksAVX2;
+    kernelName = "AVX2";
+  }
+  else if(__builtin_cpu_supports("sse2"))
+  {
+    fallBlocks = fallBlocksSSE;
+    catchBlocks = catchBlocksSSE;
+    kernelName = "SSE";
+  }
+#endif
+}
+
+/**************************
+ * Job system - work-stealing workers that run jobs once their dependencies are done
+ **************************/
+
+const char *jobStatNames[MAX_JOB_STATS] = {"block fall", "catch check"};
+int jobStatCount = CORE_STAT_COUNT;
+
+/* Every worker owns a deque - it pushes and pops at the back, and idle
+   workers steal from the front of the others. Each thread outside the system
+   that submits jobs gets a deque of its own too, and while it waits it only
+   runs jobs off that one - so the simulation and the renderer lend each other
+   the workers, but never end up running each other's jobs */
+typedef struct JobQueue {
+  mutex lock;
+  deque<Job*> jobs;
+} JobQueue;
+
+/* Job timings are kept per deque - by the one thread that owns it - so
+   finishing a job takes no lock, and are added up only when they are
+   reported. Each sits on cache lines of its own */
+typedef struct alignas(64) ThreadTimings {
+  JobTiming stats[MAX_JOB_STATS];
+} ThreadTimings;
+
+typedef struct Scheduler {
+  vector<thread> threads;
+  JobQueue *queues;
+  ThreadTimings *timings;  // One per deque, 64-byte aligned
+  int workerCount, queueCount;
+  mutex sleepLock;
+  condition_variable wake;
+  atomic<int> queued;
+  bool quit;
+} Scheduler;
+
+Scheduler scheduler;
+thread_local int workerIndex = -1;
+// Which of the submitter deques a thread outside the system uses - kept across restarts of the scheduler
+thread_local int submitterIndex = -1;
+atomic<int> submitterCount;
+
+void initJob (Job *job, JobFunction run, JobStat stat)
+{
+  job->run = run;
+  job->data = NULL;
+  job->stat = stat;
+  job->unfinished = 1;
+  job->dependentCount = 0;
+  job->done = false;
+  job->chain = 0.0;
+}
+
+/* after cannot start until before has finished. Both must still be unsubmitted */
+void addDependency (Job *before, Job *after)
+{
+  assert(before->dependentCount < MAX_JOB_DEPENDENTS);
+  before->dependents[before->dependentCount++] = after;
+  after->unfinished++;
+}
+
+/* The deque the calling thread pushes to and waits on */
+int ownQueue ()
+{
+  if(workerIndex >= 0)
+    return workerIndex;
+  if(submitterIndex < 0)
+  {
+    submitterIndex = submitterCount++;
+    assert(submitterIndex < MAX_JOB_SUBMITTERS);
+  }
+  return scheduler.workerCount + submitterIndex;
+}
+
+void enqueueJob (Job *job)
+{
+  JobQueue *queue = &scheduler.queues[ownQueue()];
+
+  {
+    lock_guard<mutex> guard(queue->lock);
+    queue->jobs.push_back(job);
+  }
+  scheduler.queued++;
+  {
+    lock_guard<mutex> guard(scheduler.sleepLock);
+  }
+  scheduler.wake.notify_one();
+}
+
+/* Hand the job over - it runs as soon as its dependencies are done */
+void submitJob (Job *job)
+{
+  if(--job->unfinished == 0)
+    enqueueJob(job);
+}
+
+/* Pop from our own deque, or failing that - if steal is set - steal from the front of another */
+Job* takeJob (bool steal)
+{
+  int i, q, own = ownQueue();
+  Job *job = NULL;
+
+  for(i = 0; i < (steal ? scheduler.queueCount : 1) && !job; i++)
+  {
+    q = (own + i) % scheduler.queueCount;
+    lock_guard<mutex> guard(scheduler.queues[q].lock);
+    if(scheduler.queues[q].jobs.empty())
+      continue;
+    if(q == own)
+    {
+      job = scheduler.queues[q].jobs.back();
+      scheduler.queues[q].jobs.pop_back();
+    }
+    else
+    {
+      job = scheduler.queues[q].jobs.front();
+      scheduler.queues[q].jobs.pop_front();
+    }
+  }
+  if(job)
+    scheduler.queued--;
+  return job;
+}
+
+void runJob (Job *job)
+{
+  int i, n;
+  double path, seen, took;
+  Job *next[MAX_JOB_DEPENDENTS];
+
+  job->begin = inputClock();
+  if(job->run)
+    job->run(job);
+  job->finish = inputClock();
+  took = job->finish - job->begin;
+  path = job->chain + took;
+
+  if(job->stat != STAT_NONE)
+  {
+    JobTiming &timing = scheduler.timings[ownQueue()].stats[job->stat];
+    timing.runs++;
+    timing.total += took;
+    timing.longest = max(timing.longest, took);
+  }
+  for(i = 0; i < job->dependentCount; i++)
+  {
+    seen = job->dependents[i]->chain;
+    while(path > seen && !job->dependents[i]->chain.compare_exchange_weak(seen, path));
+  }
+
+  // The job may be reused as soon as it is marked done, so nothing touches it after
+  n = job->dependentCount;
+  memcpy(next, job->dependents, n*sizeof(Job*));
+  job->done = true;
+  for(i = 0; i < n; i++)
+  {
+    submitJob(next[i]);
+  }
+}
+
+/* Add a slot for timing jobs of some other kind. Register every one before any job runs */
+JobStat registerJobStat (const char *name)
+{
+  assert(jobStatCount < MAX_JOB_STATS);
+  jobStatNames[jobStatCount] = name;
+  return jobStatCount++;
+}
+
+/* Add up the timings of every thread since the scheduler was started. Only
+   call it while no jobs are running */
+void mergeJobTimings (JobTiming *timings)
+{
+  int i, stat;
+
+  for(stat = 0; stat < jobStatCount; stat++)
+  {
+    timings[stat] = JobTiming();
+    for(i = 0; i < scheduler.queueCount; i++)
+    {
+      const JobTiming &timing = scheduler.timings[i].stats[stat];
+      timings[stat].runs += timing.runs;
+      timings[stat].total += timing.total;
+      timings[stat].longest = max(timings[stat].longest, timing.longest);
+    }
+  }
+}
+
+void workerLoop (int index)
+{
+  Job *job;
+
+  workerIndex = index;
+  while(true)
+  {
+    job = takeJob(true);
+    if(job)
+    {
+      runJob(job);
+      continue;
+    }
+
+    unique_lock<mutex> guard(scheduler.sleepLock);
+    scheduler.wake.wait(guard, []{ return scheduler.quit || scheduler.queued > 0; });
+    if(scheduler.quit)
+      return;
+  }
+}
+
+/* Run jobs off our own deque until job is done - the waiting thread is never
+   idle while its own graph has work, but leaves everyone else's to the workers.
+   Wait on the last job of a graph, since the jobs after it are only started once it is done */
+void waitForJob (Job *job)
+{
+  Job *other;
+
+  while(!job->done)
+  {
+    other = takeJob(false);
+    if(other)
+      runJob(other);
+    else
+      this_thread::yield();
+  }
+}
+
+/* Start threads - 1 workers. The thread that waits on a job makes up the last one */
+void startScheduler (int threads)
+{
+  int i;
+
+  scheduler.quit = false;
+  scheduler.queued = 0;
+  scheduler.workerCount = threads - 1;
+  scheduler.queueCount = scheduler.workerCount + MAX_JOB_SUBMITTERS;
+  scheduler.queues = new JobQueue[scheduler.queueCount];
+  // Plain new only promises the alignment of max_align_t before C++17
+  if(posix_memalign((void**)&scheduler.timings, alignof(ThreadTimings), scheduler.queueCount*sizeof(ThreadTimings)))
+    abort();
+  memset(scheduler.timings, 0, scheduler.queueCount*sizeof(ThreadTimings));
+  for(i = 0; i < scheduler.workerCount; i++)
+  {
+    scheduler.threads.push_back(thread(workerLoop, i));
+  }
+}
+
+void stopScheduler ()
+{
+  unsigned i;
+
+  {
+    lock_guard<mutex> guard(scheduler.sleepLock);
+    scheduler.quit = true;
+  }
+  scheduler.wake.notify_all();
+  for(i = 0; i < scheduler.threads.size(); i++)
+  {
+    scheduler.threads[i].join();
+  }
+  scheduler.threads.clear();
+  delete[] scheduler.queues;
+  free(scheduler.timings);
+}
+
+/* Split [0, count) into PARALLEL_CHUNK sized parts, run a job over each and
+   wait for them all. Chunks do not depend on the thread count, so neither
+   do the results */
+void parallelFor (ChunkJobs *chunks, JobFunction run, JobStat stat, int count, void *data)
+{
+  int part, parts = (count + PARALLEL_CHUNK - 1)/PARALLEL_CHUNK;
+
+  if((int)chunks->results.size() < parts)
+    chunks->results.resize(parts);
+  if(parts > chunks->capacity)
+  {
+    delete[] chunks->jobs;
+    chunks->jobs = new Job[parts];
+    chunks->capacity = parts;
+  }
+
+  initJob(&chunks->join, NULL, STAT_NONE);
+  for(part = 0; part < parts; part++)
+  {
+    initJob(&chunks->jobs[part], run, stat);
+    chunks->jobs[part].data = data;
+    chunks->jobs[part].part = part;
+    chunks->jobs[part].start = part*PARALLEL_CHUNK;
+    chunks->jobs[part].end = min((part + 1)*PARALLEL_CHUNK, count);
+    addDependency(&chunks->jobs[part], &chunks->join);
+  }
+
+  // A lone chunk has nobody to share with, so it runs here without going through the queues
+  if(parts <= 1 && !chunks->serial)
+  {
+    if(parts == 1)
+      runJob(&chunks->jobs[0]);
+    return;
+  }
+  if(chunks->serial)
+  {
+    for(part = 0; part < parts; part++)
+    {
+      run(&chunks->jobs[part]);
+    }
+    return;
+  }
+  for(part = 0; part < parts; part++)
+  {
+    submitJob(&chunks->jobs[part]);
+  }
+  submitJob(&chunks->join);
+  waitForJob(&chunks->join);
+}
+
+/* Parallel forms of the block kernels. Each chunk writes its results into its
+   own stretch of the output list, which is then packed down chunk by chunk -
+   the list comes out exactly as the single threaded kernel would leave it */
+void fallJob (Job *job)
+{
+  GameState *game = (GameState*) job->data;
+  int i, n = fallBlocks(game->blocks.y + job->start, job->end - job->start, game->fallStep, game->fallenBlocks + job->start);
+
+  for(i = 0; i < n; i++)
+    game->fallenBlocks[job->start + i] += job->start;
+  game->chunks.results[job->part] = n;
+}
+
+void catchJob (Job *job)
+{
+  GameState *game = (GameState*) job->data;
+  int i, n = catchBlocks(game->dueX + job->start, game->dueY + job->start, job->end - job->start, game->catchLimits, game->catchHits + job->start);
+
+  for(i = 0; i < n; i++)
+    game->catchHits[job->start + i] += 2*job->start;
+  game->chunks.results[job->part] = n;
+}
+
+int packParts (GameState *game, int *list, int count)
+{
+  int part, n = 0;
+
+  for(part = 0; part*PARALLEL_CHUNK < count; part++)
+  {
+    memmove(list + n, list + part*PARALLEL_CHUNK, game->chunks.results[part]*sizeof(int));
+    n += game->chunks.results[part];
+  }
+  return n;
+}
+
+/* Move every block down by fallStep */
+int fallBlocksParallel (GameState *game)
+{
+  parallelFor(&game->chunks, fallJob, STAT_FALL, game->blocks.count, game);
+  return packParts(game, game->fallenBlocks, game->blocks.count);
+}
+
+int catchBlocksParallel (GameState *game, int count, const float *limits)
+{
+  memcpy(game->catchLimits, limits, sizeof(game->catchLimits));
+  parallelFor(&game->chunks, catchJob, STAT_CATCH, count, game);
+  return packParts(game, game->catchHits, count);
+}
+
+/* Time the block update over count blocks with 1 to N threads and print the speedup */
+void reportScaling (GameState *game, int count)
+{
+  int i, threads, steps = 200, maxThreads = scheduler.workerCount + 1;
+  double base = 0.0;
+
+  game->maxBlocks = max(game->maxBlocks, count);
+  game->updateTime = 1000.0;
+  while(game->blocks.count < count && game->blocks.count < game->maxBlocks)
+  {
+    insertBlock(game);
+  }
+
+  game->fallStep = 0.0001f;
+  printf("Block update scaling over %d blocks (%s kernels)\n\n", game->blocks.count, kernelName);
+  printf("threads   ms/step   speedup\n");
+  for(threads = 1; threads <= maxThreads; threads++)
+  {
+    stopScheduler();
+    startScheduler(threads);
+    for(i = 0; i < game->blocks.count; i++)
+    {
+      game->blocks.y[i] = 0;
+    }
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for(i = 0; i < steps; i++)
+    {
+      fallBlocksParallel(game);
+    }
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count()/steps;
+
+    if(threads == 1)
+      base = ms;
+    printf("%7d   %7.3f   %7.2f\n", threads, ms, base/ms);
+  }
+}
+
+/**************************
+ * Stepping the game
+ **************************/
+
+/* Step by which a block at y (distance fallen) reaches the catch zone at the
+   current speed - never later, but never earlier than the next step either.
+   y moves by a float fallStep every step, so it drifts a little from the exact
+   quotient; the guess is kept a step early and updateScores() requeues a block
+   that is not there yet */
+long predictArrival (GameState *game, float y)
+{
+  return game->simTick + max(1L, (long)floor((y - catchZoneTop)/game->fallStep) - 1);
+}
+
+/* Change how far blocks fall each step, and move every pending arrival to match */
+void setSpeed (GameState *game, float speed)
+{
+  game->speed = speed;
+  game->fallStep = speed*blockStepRate*(float)simTimeStep;
+  rekeyArrivals(game);
+}
+
+/* Every block falls at the same speed, so a speed change moves all the
+   arrivals at once - recompute the keys and rebuild the heap in one pass */
+void rekeyArrivals (GameState *game)
+{
+  int i;
+
+  for(i = 0; i < game->arrivalCount; i++)
+  {
+    int slot = game->arrivalHeap[i];
+    game->arrivalTick[slot] = predictArrival(game, game->blocks.y[game->blocks.position[slot]]);
+  }
+  for(i = game->arrivalCount/2 - 1; i >= 0; i--)
+  {
+    siftArrivalDown(game, i);
+  }
+}
+
+/* Score the blocks that reach the buckets this step. Only blocks whose arrival
+   is due are looked at; those that stay in the catch zone without being
+   caught are checked again on the next step, as they fall past */
+void updateScores(GameState *game)
+{
+  int i, k, n, m = 0, slot;
+  BlockStore &blocks = game->blocks;
+  const Bucket *bucketInfo = game->bucketInfo;
+  float limits[4] = {bucketInfo[0].topLeft, bucketInfo[0].topRight, bucketInfo[1].topLeft, bucketInfo[1].topRight};
+
+  while(game->arrivalCount > 0 && game->arrivalTick[game->arrivalHeap[0]] <= game->simTick)
+  {
+    slot = game->arrivalHeap[0];
+    cancelArrival(game, slot);
+    game->dueSlots[m] = slot;
+    game->dueX[m] = blocks.x[blocks.position[slot]];
+    game->dueY[m] = blocks.y[blocks.position[slot]];
+    m++;
+  }
+
+  // No change in score while the buckets overlap
+  n = 0;
+  if(!((bucketInfo[0].topLeft <= bucketInfo[1].topLeft && bucketInfo[0].topRight >= bucketInfo[1].topLeft) ||
+    (bucketInfo[1].topLeft <= bucketInfo[0].topLeft && bucketInfo[1].topRight >= bucketInfo[0].topLeft))
+  )
+  {
+    n = catchBlocksParallel(game, m, limits);
+  }
+
+  for(i = 0; i < n; i++)
+  {
+    slot = game->dueSlots[game->catchHits[i] >> 1];
+    const CatchRule &rule = catchRules[blocks.type[blocks.position[slot]]][game->catchHits[i] & 1];
+
+    game->score = max(game->score + rule.score, 0);
+    if(rule.wrong)
+    {
+      game->wrongCatch++;
+    }
+    if(rule.remove)
+    {
+      releaseBlock(game, blocks.position[slot]);
+    }
+  }
+
+  // Requeue the rest until they drop out of the bottom of the catch zone
+  for(i = 0; i < m; i++)
+  {
+    k = blocks.position[game->dueSlots[i]];
+    if(k >= 0 && blocks.y[k] > catchZoneBottom)
+    {
+      scheduleArrival(game, game->dueSlots[i], predictArrival(game, blocks.y[k]));
+    }
+  }
+}
+
+/* Fire the death ray from the cannon - traces its path through the mirrors
+   and destroys the first block it hits */
+void traceDeathRay (GameState *game, float dt)
+{
+  int i, hit, hitMirror, lastMirror = -1;
+  float ox, oy, dx, dy, mx, my, wx, wy, denom, t, u, tEnd, dot;
+  const Mirror *mirrorInfo = game->mirrorInfo;
+
+  game->raySegmentCount = 0;
+
+  if(game->keyStates[GAME_KEY_SPACE] && game->juiceEndX > juiceStartX)
+  {
+    game->juiceEndX = max(game->juiceEndX - juiceDrainRate*dt, juiceStartX);
+    ox = game->rayPoints[0];
+    oy = game->rayPoints[1];
+    dx = cos(game->cannonInfo.angle*M_PI/180.0f);
+    dy = sin(game->cannonInfo.angle*M_PI/180.0f);
+
+    // Each pass draws one segment, so the segment buffer bounds the number of bounces
+    while(game->raySegmentCount < MAX_RAY_SEGMENTS)
+    {
+      // Distance to the edge of the play area
+      tEnd = 1000.0;
+      if(dx > rayEpsilon)
+        tEnd = min(tEnd, (screenRightX - 6.0f - ox)/dx);
+      else if(dx < -rayEpsilon)
+        tEnd = min(tEnd, (screenLeftX - ox)/dx);
+      if(dy > rayEpsilon)
+        tEnd = min(tEnd, (screenTopY - oy)/dy);
+      else if(dy < -rayEpsilon)
+        tEnd = min(tEnd, (screenBottomY - oy)/dy);
+
+      // Nearest mirror along the ray. The mirror just bounced off is skipped, and
+      // hits closer than rayEpsilon are ignored so the ray cannot catch its own origin
+      hitMirror = -1;
+      for(i = 0; i < game->mirrorCount; i++)
+      {
+        if(i == lastMirror)
+          continue;
+
+        mx = mirrorInfo[i].x2 - mirrorInfo[i].x;
+        my = mirrorInfo[i].y2 - mirrorInfo[i].y;
+        denom = dx*my - dy*mx;
+
+        // Ray parallel to mirror
+        if(fabs(denom) < rayEpsilon)
+          continue;
+
+        wx = mirrorInfo[i].x - ox;
+        wy = mirrorInfo[i].y - oy;
+        t = (wx*my - wy*mx)/denom;
+        u = (wx*dy - wy*dx)/denom;
+        if(t > rayEpsilon && t < tEnd && 0.0 <= u && u <= 1.0)
+        {
+          tEnd = t;
+          hitMirror = i;
+        }
+      }
+
+      // Ray intersects with a block before intersecting with a mirror
+      hit = firstBlockOnRay(game, ox, oy, dx, dy, tEnd, &t);
+      if(hit >= 0)
+      {
+        addDeathRaySegment(game, ox, oy, ox + t*dx, oy + t*dy);
+
+        game->juiceEndX = juiceStartX;
+
+        if(game->blocks.type[hit] != 2)
+        {
+          game->score = max(game->score - 20, 0);
+          game->wrongHits++;
+        }
+        else
+        {
+          game->score += 10;
+        }
+        releaseBlock(game, hit);
+        break;
+      }
+
+      addDeathRaySegment(game, ox, oy, ox + tEnd*dx, oy + tEnd*dy);
+
+      // Death Ray leaves the play area
+      if(hitMirror == -1)
+        break;
+
+      // Reflect off the mirror about its normal and carry on from the point of intersection
+      ox += tEnd*dx;
+      oy += tEnd*dy;
+      dot = dx*mirrorInfo[hitMirror].nx + dy*mirrorInfo[hitMirror].ny;
+      dx -= 2*dot*mirrorInfo[hitMirror].nx;
+      dy -= 2*dot*mirrorInfo[hitMirror].ny;
+      lastMirror = hitMirror;
+    }
+  }
+}
+
+bool gameOver (const GameState *game)
+{
+  return game->wrongHits >= maxWrongHits || game->wrongCatch >= maxWrongCatches;
+}
+
+/* Advance the game by one step of simTimeStep seconds. The step is fixed, not
+   a parameter - catch checks are scheduled by step number, predicted from
+   fallStep, the same distance the blocks are moved by here */
+void update (GameState *game)
+{
+  int i, n;
+  const float dt = simTimeStep;
+
+  game->simTick++;
+  heldInputCheck(game, dt);
+
+  // Move the falling blocks - those that fall off the bottom free their slot
+  n = fallBlocksParallel(game);
+  for(i = n - 1; i >= 0; i--)
+  {
+    releaseBlock(game, game->fallenBlocks[i]);
+  }
+
+  // Recharge the battery
+  if(game->juiceEndX <= screenLeftX + 1.0)
+  {
+    game->juiceEndX += juiceRechargeRate*dt;
+  }
+
+  traceDeathRay(game, dt);
+  updateScores(game);
+
+  // Spawn a new block every updateTime seconds
+  game->spawnTime += dt;
+  while(game->spawnTime >= game->updateTime)
+  {
+    insertBlock(game);
+    game->spawnTime -= game->updateTime;
+  }
+}
@@ -0,0 +1,246 @@
+/* Brick breaker game rules, free of any windowing or GL code.
+   Everything a game needs lives in a GameState - blocks, buckets, cannon,
+   mirrors, score and held input - and the functions here step it. A front
+   end never changes a GameState. Between steps it copies the parts it draws
+   into a snapshot of its own - a GameState holds jobs and atomics, so it
+   cannot be copied whole */
+#ifndef BRICKCORE_H
+#define BRICKCORE_H
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#define BLOCK_CHUNK 4096
+#define PARALLEL_CHUNK 4096
+#define MAX_JOB_DEPENDENTS 4
+#define MAX_JOB_SUBMITTERS 4 // Threads outside the job system that may submit jobs
+#define MAX_JOB_STATS 16
+#define MAX_RAY_SEGMENTS 100
+#define BLOCK_COLUMNS 64
+
+static const float screenLeftX = -11.0;
+static const float screenRightX = 11.0;
+static const float screenTopY = 6.0;
+static const float screenBottomY = -6.0;
+// Blocks are spawned with their bottom edge here - block y is the distance fallen from it
+static const float blockInitY = 5.7;
+// Blocks spawn centred somewhere between these, and are 0.1 wide - so none ever reaches past blockSpawnRightX + 0.05
+static const float blockSpawnLeftX = -5.94, blockSpawnRightX = 3.5, blockHalfWidth = 0.05;
+// Battery charge bar - juiceEndX in the game state says how far it is filled
+static const float juiceStartX = screenLeftX + 0.2, juiceStartY = screenTopY - 0.5, juiceEndY = screenTopY - 1.0;
+
+// Simulation runs in fixed steps, independent of how often the screen is drawn
+static const double simTimeStep = 1.0/240.0;
+// The game is over after this many blocks shot that should have been caught, or caught that should have been shot
+static const int maxWrongHits = 10;
+static const int maxWrongCatches = 1;
+
+/* Falling blocks in structure-of-arrays form. Live blocks are packed at the
+   front of x, y and type so hot loops only walk [0, count) - removal swaps
+   the last live block into the hole. slot[] is the stable slot of each live
+   block and position[] maps a slot back to where its block is packed.
+   Free slots are kept on a stack so acquiring and releasing are O(1).
+   The arrays grow BLOCK_CHUNK slots at a time, up to maxBlocks, when the
+   free stack runs dry. Blocks are only ever referred to by slot or position,
+   never by pointer, so growing keeps every live index valid */
+typedef struct BlockStore {
+  float *x;
+  float *y;
+  int *type;
+  int *slot;
+  int *position; // -1 when the slot is free
+  int count;
+  int *freeSlots;
+  int freeCount;
+  int capacity;
+  long exhausted; // Spawns dropped because every slot was taken
+} BlockStore;
+
+typedef struct Bucket {
+  float topLeft;
+  float topRight;
+  float bottomLeft;
+  float bottomRight;
+  float initLeft;
+  bool selected;
+} Bucket;
+
+typedef struct Mirror {
+  float x;
+  float y;
+  float length;
+  float angle;
+  float x2, y2;   // far end point
+  float nx, ny;   // unit normal
+} Mirror;
+
+typedef struct Cannon {
+  float y;
+  float angle;
+  static constexpr float length = 1.5;
+  static constexpr float thickness = 0.3;
+  bool selected;
+} Cannon;
+
+/* PCG32 random number generator. Each stream of a game has its own
+   increment, so streams seeded alike still never give the same sequence */
+typedef struct Random {
+  uint64_t state;
+  uint64_t inc;
+} Random;
+
+// Independent streams of a game - drawing more from one never shifts the others
+enum RandomStream { STREAM_SPAWN_X = 1, STREAM_BLOCK_TYPE, STREAM_MIRRORS };
+
+/* Keys and mouse buttons the game reacts to. Whatever reads the real
+   keyboard translates its key codes to these */
+enum GameKey {
+  GAME_KEY_LEFT, GAME_KEY_RIGHT,
+  GAME_KEY_LEFT_ALT, GAME_KEY_RIGHT_ALT, GAME_KEY_LEFT_CONTROL, GAME_KEY_RIGHT_CONTROL,
+  GAME_KEY_A, GAME_KEY_D, GAME_KEY_S, GAME_KEY_F, GAME_KEY_SPACE,
+  GAME_KEY_I, GAME_KEY_O, GAME_KEY_N, GAME_KEY_M,
+  GAME_KEY_COUNT
+};
+enum GameButton { GAME_BUTTON_LEFT, GAME_BUTTON_RIGHT, GAME_BUTTON_MIDDLE, GAME_BUTTON_COUNT };
+
+enum InputType { INPUT_KEY, INPUT_MOUSE_BUTTON, INPUT_CURSOR };
+
+/* One press, release or cursor move, stamped with the time it happened */
+typedef struct InputEvent {
+  double time;
+  InputType type;
+  int code;       // GameKey or GameButton
+  bool pressed;
+  double x, y;    // Cursor position in game coordinates
+} InputEvent;
+
+/**************************
+ * Job system - work-stealing workers that run jobs once their dependencies are done
+ **************************/
+
+/* What each job is timed as. The core's own come first, and a front end
+   adds slots for its jobs with registerJobStat */
+typedef int JobStat;
+enum { STAT_NONE = -1, STAT_FALL, STAT_CATCH, CORE_STAT_COUNT };
+extern const char *jobStatNames[MAX_JOB_STATS];
+extern int jobStatCount;
+
+typedef struct Job Job;
+typedef void (*JobFunction)(Job *job);
+
+/* A unit of work. It becomes runnable when the last job it depends on
+   finishes, and on finishing releases the jobs that depend on it. Jobs are
+   owned by whoever submits them and must stay alive until waitForJob returns.
+   A job with no function just joins its dependencies */
+struct Job {
+  JobFunction run;
+  void *data;                    // Whatever the function works on
+  int part, start, end;          // Which chunk of a range to work on
+  JobStat stat;
+  std::atomic<int> unfinished;   // Dependencies still to finish, plus one until submitted
+  Job *dependents[MAX_JOB_DEPENDENTS];
+  int dependentCount;
+  std::atomic<bool> done;
+  double begin, finish;          // When it ran, on inputClock
+  std::atomic<double> chain;     // Longest run of dependencies finishing before it could start
+};
+
+typedef struct JobTiming {
+  long runs;
+  double total, longest;
+} JobTiming;
+
+/* Chunk jobs and per-chunk results of a parallelFor. Each caller that may
+   run one at the same time as another needs its own */
+typedef struct ChunkJobs {
+  Job *jobs;
+  Job join;
+  int capacity;
+  std::vector<int> results;
+  // Run every chunk on the calling thread, untimed - for callers that already keep every core busy
+  bool serial = false;
+} ChunkJobs;
+
+
+double inputClock ();
+void initJob (Job *job, JobFunction run, JobStat stat);
+void addDependency (Job *before, Job *after);
+void submitJob (Job *job);
+void waitForJob (Job *job);
+void startScheduler (int threads);
+void stopScheduler ();
+JobStat registerJobStat (const char *name);
+void mergeJobTimings (JobTiming *timings);
+void parallelFor (ChunkJobs *chunks, JobFunction run, JobStat stat, int count, void *data);
+
+/**************************
+ * Game state
+ **************************/
+
+typedef struct GameState {
+  // Settings - kept by initGame
+  int maxBlocks = 5000; // Upper bound on the pool - raised with --max-blocks
+  float updateTime = 1, speed = 0.05;
+  uint64_t seed = 0;    // Same seed, same spawns and mirrors
+
+  Random spawnX, spawnType, mirrorLayout;
+
+  int score, wrongHits, wrongCatch;
+  float spawnTime, rayPoints[2];
+  // How far the battery is charged
+  float juiceEndX;
+  double mouseX, mouseY;
+  bool selected;
+
+  BlockStore blocks;
+
+  /* Blocks bucketed by the column of the play area they fall through. A block's
+     x never changes, so it joins its column on spawn and leaves on release.
+     Columns are linked lists threaded through the block slots */
+  int columnHead[BLOCK_COLUMNS], *nextInColumn, *prevInColumn;
+
+  /* Blocks waiting to reach the catch zone, as a min-heap of slots keyed on the
+     step their fall brings them there. arrivalPos maps a slot back to its heap
+     entry (-1 when not queued) so a block shot down early can be pulled out */
+  long simTick, *arrivalTick;
+  int *arrivalHeap, *arrivalPos, arrivalCount;
+
+  // Scratch lists filled by the block kernels each step
+  int *catchHits, *fallenBlocks;
+  // Blocks due for a catch check this step
+  int *dueSlots;
+  float *dueX, *dueY;
+  // How far every block falls in a step - set with the speed, and used for both moving blocks and predicting arrivals
+  float fallStep;
+  // Arguments of the parallel kernels
+  float catchLimits[4];
+  ChunkJobs chunks;
+
+  Bucket bucketInfo[2];
+  int mirrorCount;
+  Mirror mirrorInfo[5];
+  Cannon cannonInfo;
+
+  // Held state of every key and mouse button, as seen by the simulation
+  bool keyStates[GAME_KEY_COUNT], mouseStates[GAME_BUTTON_COUNT];
+  double cursorX, cursorY;
+
+  // End points of every segment of the current death ray path, as GL_LINES vertices
+  float rayVertexData[6*MAX_RAY_SEGMENTS];
+  int raySegmentCount;
+} GameState;
+
+extern const char *kernelName;
+
+/* Start a new game - blocks, buckets, mirrors and cannon are laid out afresh.
+   Anything a previous game held must have been let go with freeGame */
+void initGame (GameState *game);
+void freeGame (GameState *game);
+void applyInput (GameState *game, const InputEvent *event);
+void update (GameState *game);
+bool gameOver (const GameState *game);
+void insertBlock (GameState *game);
+void reportScaling (GameState *game, int count);
+
+#endif